@@ -0,0 +1,94 @@
+/**
+ * This example illustrates the inline kernel of the GULL library, i.e.
+ * computing the geomagnetic field of a snapshot within a host loop, with the
+ * inline functions of "gull-kernel.h". The kernel results are compared to
+ * the library ones, i.e. `gull_snapshot_field`. This example compiles as C99
+ * or as C++.
+ */
+
+#include "gull-kernel.h"
+/* C89 standard library */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Handle for a snapshot of the geomagnetic field. */
+static struct gull_snapshot * snapshot = NULL;
+
+/* Buffer for the coefficients of the kernel. */
+static double * columns = NULL;
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        /* Dump an error message. */
+        fprintf(stderr, "%s\n", message);
+
+        /* Finalise and exit to the OS. */
+        gull_snapshot_destroy(&snapshot);
+        free(columns);
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char * argv[])
+{
+        /* Register the error handler for GULL library functions. */
+        gull_error_handler_set(&handle_error);
+
+        /* Create a snapshot of the magnetic field. */
+        const char * path = (argc == 1) ? "share/data/IGRF13.COF" : argv[1];
+        const int day = 23, month = 3, year = 2020;
+        gull_snapshot_create(&snapshot, path, day, month, year);
+
+        /** Let us initialise the inline kernel for this snapshot. The
+         * coefficients are exported to a buffer owned by the caller, which
+         * must outlive the kernel.
+         */
+        struct gull_kernel kernel;
+        const size_t size = gull_kernel_initialise(&kernel, snapshot, NULL);
+        columns = (double *)malloc(size * sizeof(*columns));
+        if (columns == NULL) {
+                fprintf(stderr, "could not allocate memory\n");
+                gull_snapshot_destroy(&snapshot);
+                exit(EXIT_FAILURE);
+        }
+        gull_kernel_initialise(&kernel, snapshot, columns);
+
+        /** Then, let us scan the latitude at a fixed longitude and altitude,
+         * including the poles, and compare to the library results.
+         */
+        const double longitude = 2.95536402;
+        const double altitude = 1090.;
+        double max_diff = 0.;
+        int i;
+        for (i = 0; i <= 180; i++) {
+                const double latitude = -90. + i;
+                double field[3], expected[3];
+                if (!gull_kernel_field(
+                        &kernel, latitude, longitude, altitude, field)) {
+                        fprintf(stderr, "altitude out of the model domain\n");
+                        break;
+                }
+                gull_snapshot_field(snapshot, latitude, longitude, altitude,
+                    expected, NULL);
+
+                const double norm = sqrt(expected[0] * expected[0] +
+                    expected[1] * expected[1] + expected[2] * expected[2]);
+                int j;
+                for (j = 0; j < 3; j++) {
+                        const double d = fabs(field[j] - expected[j]) / norm;
+                        if (d > max_diff) max_diff = d;
+                }
+        }
+
+        printf("# Inline kernel\n");
+        printf("- data set   : %s\n", path);
+        printf("- max diff   : %.3E (relative to the field norm)\n",
+            max_diff);
+
+        /* Finalise and exit to the OS. */
+        gull_snapshot_destroy(&snapshot);
+        free(columns);
+        exit((max_diff < 1E-12) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
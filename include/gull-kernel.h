@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Inline kernel of GULL, for evaluating the geomagnetic field of a snapshot
+ * within the calling loops of host code, instead of calling
+ * `gull_snapshot_field` through the library boundary. This header is self
+ * contained and can be installed alongside "gull.h". It compiles as C99 or as
+ * C++, and it only depends on the public API of the library, for exporting
+ * the coefficients of the snapshot, see `gull_snapshot_columns`.
+ *
+ * The kernel is a scalar version of the column kernel of the library, thus it
+ * agrees with `gull_snapshot_field` up to floating point rounding. Note that
+ * the kernel does not raise any error, e.g. for altitudes out of the model
+ * validity range. Instead, it returns a validity flag.
+ */
+#ifndef GULL_KERNEL_H
+#define GULL_KERNEL_H
+
+#include "gull.h"
+/* C89 standard library */
+#include <math.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Data of the inline kernel, for a snapshot.
+ */
+struct gull_kernel {
+        /** The order of the snapshot. */
+        int order;
+        /** The minimum altitude of validity, in m. */
+        double altitude_min;
+        /** The maximum altitude of validity, in m. */
+        double altitude_max;
+        /** The coefficients by columns, see `gull_snapshot_columns`. */
+        const double * columns;
+};
+
+/**
+ * Initialise the inline kernel for a snapshot.
+ *
+ * @param kernel      The kernel to initialise.
+ * @param snapshot    A handle to the snapshot.
+ * @param columns     A buffer for the coefficients, or `NULL`.
+ * @return The number of doubles of the buffer.
+ *
+ * The *columns* buffer must hold `gull_snapshot_columns(snapshot, NULL)`
+ * doubles. It is owned by the caller, and it must outlive the kernel. If
+ * *columns* is `NULL`, only the required size is returned and *kernel* is not
+ * modified. The kernel does not refer to *snapshot*, which can be destroyed
+ * after initialisation.
+ */
+static inline size_t gull_kernel_initialise(struct gull_kernel * kernel,
+    struct gull_snapshot * snapshot, double * columns)
+{
+        const size_t size = gull_snapshot_columns(snapshot, columns);
+        if (columns == NULL) return size;
+        gull_snapshot_info(snapshot, &kernel->order, &kernel->altitude_min,
+            &kernel->altitude_max);
+        kernel->columns = columns;
+        return size;
+}
+
+/**
+ * Compute the geomagnetic field components with the inline kernel.
+ *
+ * @param kernel      The initialised kernel.
+ * @param latitude    The geodetic latitude, in deg.
+ * @param longitude   The geodetic longitude, in deg.
+ * @param altitude    The altitude above sea level, in m.
+ * @param magnet      The computed magnetic field components, in T.
+ * @return 1 if the altitude is within the validity range of the snapshot,
+ * 0 otherwise.
+ *
+ * The components are returned in **E**ast, **North** and **U**pward (E,N,U)
+ * coordinates, as for `gull_snapshot_field`. They are always computed, even
+ * if the altitude is out of the validity range.
+ */
+static inline int gull_kernel_field(const struct gull_kernel * kernel,
+    double latitude, double longitude, double altitude, double magnet[3])
+{
+        /* The WGS84 ellipsoid and the reference radius of the models, in km. */
+        const double earths_radius = 6371.2;
+        const double a2 = 40680631.59;
+        const double b2 = 40408299.98;
+        const double deg = 3.14159265358979323846 / 180.;
+
+        /*
+         * The scaling of the Legendre functions, preventing underflows at
+         * large orders, as in the library.
+         */
+        const double scale = ldexp(1., 930);
+
+        const int order = kernel->order;
+        const int npq = (order * (order + 3)) / 2;
+        const double * const g = kernel->columns;
+        const double * const h = g + npq;
+        const double * const a = h + npq;
+        const double * const b = a + npq;
+
+        /* Convert the location to geocentric, with protection at poles. */
+        const double alt = altitude * 1E-03;
+        const double slat0 = sin(latitude * deg);
+        double lat = latitude;
+        if ((90.0 - latitude) < 0.001)
+                lat = 89.999;
+        else if ((90.0 + latitude) < 0.001)
+                lat = -89.999;
+        const double clat0 = cos(lat * deg);
+        const double slon = sin(longitude * deg);
+        const double clon = cos(longitude * deg);
+
+        const double aa = a2 * clat0 * clat0;
+        const double bb = b2 * slat0 * slat0;
+        const double cc = aa + bb;
+        const double dd = sqrt(cc);
+        const double r =
+            sqrt(alt * (alt + 2. * dd) + (a2 * aa + b2 * bb) / cc);
+        const double ratio = earths_radius / r;
+        const double cd = (alt + dd) / r;
+        const double sd = (a2 - b2) * slat0 * clat0 / (dd * r);
+        const double slat = slat0 * cd - clat0 * sd;
+        const double clat = clat0 * cd + slat0 * sd;
+
+        /*
+         * Recurse the Legendre functions by columns of order m, with the
+         * radial factors (a / r)^(n + 2) folded in.
+         */
+        const int regular = clat > 0.;
+        const double sr = slat * ratio;
+        const double cr = clat * ratio;
+        const double r2 = ratio * ratio;
+        double pmm = r2 * scale, qmm = 0., cm = 1., sm = 0.;
+        double x = 0., y = 0., z = 0.;
+        int m, k = 0;
+        for (m = 0; m <= order; m++) {
+                double p1, q1, p2 = 0., q2 = 0.;
+                double gq = 0., hq = 0., gp = 0., hp = 0., gz = 0., hz = 0.;
+                int n;
+                if (m == 0) {
+                        p1 = pmm;
+                        q1 = 0.;
+                        n = 1;
+                } else {
+                        /* Recurse the sectoral terms, and the harmonics. */
+                        if (m == 1) {
+                                const double p = cr * pmm;
+                                qmm = sr * pmm;
+                                pmm = p;
+                        } else {
+                                const double t = a[k];
+                                const double p = t * cr * pmm;
+                                qmm = t * (cr * qmm + sr * pmm);
+                                pmm = p;
+                        }
+                        const double tmp = cm * clon - sm * slon;
+                        sm = sm * clon + cm * slon;
+                        cm = tmp;
+
+                        const double w = m + 1.;
+                        gq = g[k] * qmm;
+                        hq = h[k] * qmm;
+                        gp = g[k] * pmm;
+                        hp = h[k] * pmm;
+                        gz = w * gp;
+                        hz = w * hp;
+                        p1 = pmm;
+                        q1 = qmm;
+                        n = m + 1;
+                        k++;
+                }
+
+                /* Recurse the Legendre functions of degree n > m. */
+                for (; n <= order; n++, k++) {
+                        const double w = n + 1.;
+                        const double p = a[k] * sr * p1 - b[k] * r2 * p2;
+                        const double q =
+                            a[k] * (sr * q1 - cr * p1) - b[k] * r2 * q2;
+                        p2 = p1;
+                        q2 = q1;
+                        p1 = p;
+                        q1 = q;
+                        gq += g[k] * q;
+                        hq += h[k] * q;
+                        gp += g[k] * p;
+                        hp += h[k] * p;
+                        gz += w * g[k] * p;
+                        hz += w * h[k] * p;
+                }
+
+                /* Sum up the contributions of order m. */
+                x += cm * gq + sm * hq;
+                z -= cm * gz + sm * hz;
+                y += regular ? m * (sm * gp - cm * hp) : sm * gq - cm * hq;
+        }
+
+        /* Rotate to geodetic, and unscale. */
+        const double unit = 1E-09 / scale;
+        const double yfactor = regular ? 1. / clat : slat;
+        magnet[0] = y * yfactor * unit;
+        magnet[1] = (x * cd + z * sd) * unit;
+        magnet[2] = -(z * cd - x * sd) * unit;
+
+        return (altitude >= kernel->altitude_min) &&
+            (altitude <= kernel->altitude_max);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -19,8 +19,7 @@
  */
 
 #ifndef GULL_H
-#define GULL_h
-#endif
+#define GULL_H
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -100,8 +99,19 @@ struct gull_snapshot;
  *     *.COF    From **geomag70**. List of coefficients grouped by year, with
  * a header, e.g. IGRF12.COF or WWM2015.COF.
  *
+ *     binary   Compiled data produced by `gull_model_dump`, e.g. from a COF
+ * file. Binary files are recognised from their content, not their extension.
+ *
+ * High resolution models, e.g. crustal field models, are supported up to order
+ * 2700. The associated Legendre functions are recursed with a scaling that
+ * prevents their underflow near the poles. The cost of evaluating the field
+ * scales as the squared order, i.e. about 4 ns per pair of coefficients.
+ *
  * __Error codes__
  *
+ *     GULL_RETURN_FORMAT_ERROR     The data file has a wrong format, or its
+ * order is larger than 2700.
+ *
  *     GULL_RETURN_MEMORY_ERROR     Couldn't allocate memory.
  *
  *     GULL_RETURN_PATH_ERROR       The data file couldn't be found/opened.
@@ -112,12 +122,60 @@ struct gull_snapshot;
 enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
     const char * path, int day, int month, int year);
 
+/**
+ * Get a shared snapshot of a geomagnetic model.
+ *
+ * @param snapshot   A handle to the snapshot.
+ * @param path       The file containing the geomagnetic model data.
+ * @param day        The day in the month, i.e. in [1,31].
+ * @param month      The month of the year, i.e. in [1, 12].
+ * @param year       The year number, e.g. 2018.
+ * @param resolution The date resolution, in days, or 0.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_create` except that the
+ * snapshot is taken from a process wide cache, keyed by *path* and date. The
+ * snapshot is loaded on the first request, and subsequent requests share it,
+ * with reference counting. Each call must be balanced by a call to
+ * `gull_snapshot_destroy`, which releases the reference. The snapshot is
+ * freed once all references have been released.
+ *
+ * If *resolution* is larger than 1, the date is quantised to the first day
+ * of its period of *resolution* days, counted from the start of the *year*.
+ * This allows to share snapshots between nearby dates.
+ *
+ * Shared snapshots must not be modified. Note that `gull_model_snapshot`
+ * releases a shared snapshot and then allocates a new one, instead of
+ * overwriting it. The cache is thread safe when POSIX threads are available,
+ * which is the default on UNIX systems. Paths are compared as strings, thus
+ * different paths to the same file result in distinct snapshots.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR     The provided date is not valid.
+ *
+ *     GULL_RETURN_FORMAT_ERROR     The data file has a wrong format.
+ *
+ *     GULL_RETURN_MEMORY_ERROR     Couldn't allocate memory.
+ *
+ *     GULL_RETURN_PATH_ERROR       The data file couldn't be found/opened.
+ *
+ *     GULL_RETURN_MISSING_DATA     There is no valid data for the
+ * requested date.
+ */
+enum gull_return gull_snapshot_create_shared(struct gull_snapshot ** snapshot,
+    const char * path, int day, int month, int year, int resolution);
+
 /**
  * Destroy a snapshot.
  *
  * @param snapshot   A handle to the snapshot.
  *
- * Fully destroy a snapshot and free any allocated memory.
+ * Fully destroy a snapshot and free any allocated memory. If the snapshot is
+ * shared, see `gull_snapshot_create_shared`, a reference is released instead,
+ * and the snapshot is freed with its last reference. Note that a `NULL` value
+ * is set to *snapshot* on exit.
  */
 void gull_snapshot_destroy(struct gull_snapshot ** snapshot);
 
@@ -140,6 +198,10 @@ void gull_snapshot_destroy(struct gull_snapshot ** snapshot);
  * again in subsequent calls. Otherwise the temporary workspace is freed at
  * exit.
  *
+ * A reused workspace also caches the radial factors of the spherical harmonic
+ * expansion. These are carried over to subsequent calls sharing the same
+ * geocentric radius, e.g. when scanning along a parallel at constant altitude.
+ *
  * This function is thread safe provided that each thread manages its own
  * *workspace*, which is in particular true if *workspace* is set to `NULL`.
  *
@@ -155,50 +217,1115 @@ enum gull_return gull_snapshot_field(struct gull_snapshot * snapshot,
     double ** worspace);
 
 /**
- * Information on a geomagnetic snapshot.
+ * Compute the geomagnetic field up to some order of the expansion.
  *
- * @param snapshot        A handle to the snapshot.
- * @param order           The order used for spherical harmonics.
- * @param altitude_min    The minimum altitude (m) at which the model is valid.
- * @param altitude_max    The maximum altitude (m) at which the model is valid.
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param order        The maximum order to use, or 0.
+ * @param tolerance    The tolerance on the dropped terms (T), or 0.
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param order_used   The order actually used, or `NULL`.
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
  *
- * Get some basic information on a geomagnetic snapshot. Note that any output
- * parameter can be set to `NULL` if the corresponding property is not needed.
+ * This function is equivalent to `gull_snapshot_field` except that the
+ * spherical harmonic expansion is truncated. The sum runs up to *order*, or up
+ * to the order of the snapshot if *order* is not strictly positive.
+ *
+ * In addition, if *tolerance* is strictly positive, the sum is stopped at the
+ * lowest order for which the dropped terms are below *tolerance*. The dropped
+ * terms are estimated from the power spectrum of the snapshot (Lowes &
+ * Mauersberger) at the geocentric radius of the location, i.e. as their RMS
+ * over the sphere. Note that the local error can exceed this estimate, by a
+ * factor of about 2 to 3. Since high order terms are damped with the radius,
+ * this is effective at high altitudes, e.g. in the magnetosphere.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
  */
-void gull_snapshot_info(struct gull_snapshot * snapshot, int * order,
-    double * altitude_min, double * altitude_max);
+enum gull_return gull_snapshot_field_truncated(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, int order,
+    double tolerance, double field[3], int * order_used, double ** workspace);
 
 /**
- * Return a string describing a GULL library function.
+ * Compute the geomagnetic field using a user supplied workspace.
  *
- * @param function    The library function.
- * @return a static string.
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param buffer       The memory to use as temporary workspace.
+ * @param size         The size of *buffer*, in bytes.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
  *
- * This function is meant for verbosing when handling errors.
+ * This function is equivalent to `gull_snapshot_field` except that the
+ * temporary workspace is provided by the user, e.g. on the stack or from an
+ * arena. No memory is allocated. The required *size* is given by
+ * `gull_snapshot_workspace_size`. The *buffer* must be suitably aligned for
+ * storing doubles.
+ *
+ * The *buffer* caches data between successive calls. Thus, it must be zeroed
+ * before its first use, e.g. with `memset`, and it must not be shared between
+ * threads.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The provided buffer is too small.
  */
-const char * gull_error_function(gull_function_t * function);
+enum gull_return gull_snapshot_field_buffer(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double field[3],
+    void * buffer, size_t size);
 
 /**
- * Get the current error handler.
+ * Compute the geomagnetic field at an ECEF position.
  *
- * @return The current error handler or `NULL` if none.
+ * @param snapshot     A handle to the snapshot.
+ * @param position     The Earth-Centred Earth-Fixed (ECEF) position (m).
+ * @param field        The corresponding magnetic field ECEF components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_field` except that the
+ * location and the field are given in Cartesian ECEF coordinates, i.e. with
+ * the z-axis along the Earth's rotation axis and the x-axis crossing the
+ * Greenwich meridian at the equator. The position is used directly as
+ * geocentric coordinates, thus no geodetic conversion is performed. Note that
+ * neither is there any protection against poles.
+ *
+ * The altitude above the reference ellipsoid (WGS84) is only needed for
+ * checking the validity of the model. It is approximated by the distance to
+ * the ellipsoid along the geocentric radius. This differs from the geodetic
+ * altitude by less than 10 m below 1000 km of altitude.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
  */
-gull_handler_cb * gull_error_handler_get(void);
+enum gull_return gull_snapshot_field_ecef(struct gull_snapshot * snapshot,
+    const double position[3], double field[3], double ** workspace);
 
 /**
- * Set or clear the error handler.
+ * Compute the geomagnetic field and its spatial gradient.
  *
- * @param handler    The error handler to set or `NULL`.
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param gradient     The spatial derivatives of the field components (T/m).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
  *
- * Set the error handler callback for GULL library functions. If *handler* is
- * set to `NULL` error callbacks are disabled.
+ * This function is equivalent to `gull_snapshot_field` except that the
+ * spatial derivatives of the field are computed as well, analytically and in
+ * the same pass. The derivative of the *i*-th field component along the *j*-th
+ * axis is written to `gradient[3 * i + j]`, with axes and components in the
+ * local E, N, U frame at the requested location. The frame is considered as
+ * fixed, i.e. *gradient* is the Cartesian gradient tensor of the field.
+ * Since the field derives from a potential, without sources, this matrix is
+ * symmetric and traceless.
  *
- * __Warnings__
+ * The computation is about 1.5 times as long as `gull_snapshot_field`. The
+ * temporary workspace is managed as for `gull_snapshot_field`.
  *
- * This function is **not** thread safe.
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
  */
-void gull_error_handler_set(gull_handler_cb * handler);
+enum gull_return gull_snapshot_field_gradient(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double field[3],
+    double gradient[9], double ** workspace);
 
-#ifdef __cplusplus
-}
+/**
+ * Compute the geomagnetic field and its secular variation.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param rate         The time derivative of the field components (T/year).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_field` except that the time
+ * derivative of the field is returned as well, in a single pass over the
+ * spherical harmonics. The secular variation coefficients are those used for
+ * building the snapshot, i.e. the tabulated secular variation when
+ * extrapolating, or the difference of the bracketing epochs when
+ * interpolating.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_rate(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double field[3],
+    double rate[3], double ** workspace);
+
+/**
+ * Compute the geomagnetic field for a batch of locations.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param n            The number of locations.
+ * @param latitude     The geodetic latitudes (deg).
+ * @param longitude    The geodetic longitudes (deg).
+ * @param altitude     The altitudes (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This is a vectorised version of `gull_snapshot_field`. The *latitude*,
+ * *longitude* and *altitude* arrays must contain *n* values. The E, N, U
+ * components for the *i*-th location are written to `field[3 * i]`,
+ * `field[3 * i + 1]` and `field[3 * i + 2]`, i.e. *field* must hold *n* x 3
+ * values. The temporary workspace is configured once for the whole batch and
+ * is managed as for `gull_snapshot_field`.
+ *
+ * Locations are evaluated by groups of 8 with a vectorised kernel, when the
+ * library is compiled with GCC or clang. On x86, the instruction set, i.e.
+ * AVX-512, AVX2 or SSE2, is selected at runtime. Up to order 32, the results
+ * are bit identical to `gull_snapshot_field`, unless the library is compiled
+ * with floating point contraction, e.g. `-ffp-contract=fast`. In the latter
+ * case, relative differences are at the level of the double precision, i.e.
+ * 1E-15. The vectorised kernel can be disabled by defining `GULL_NO_SIMD` when
+ * compiling the library.
+ *
+ * Above order 32, groups of locations are evaluated by a vectorised kernel
+ * looping over the orders m first, whose summation order differs from
+ * `gull_snapshot_field`. Thus, results are not bit identical. Relative
+ * differences are at the level of the rounding errors of the sums, e.g. below
+ * 1.5E-14 for an order 60 model. They can be larger where the sums cancel,
+ * e.g. close to the poles.
+ *
+ * The field is computed for all locations, including invalid ones. In the
+ * latter case a single error is reported, for the first invalid location,
+ * once the whole batch has been processed. See `gull_snapshot_field_checked`
+ * for per location validity flags instead.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    Some provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_v(struct gull_snapshot * snapshot, int n,
+    const double * latitude, const double * longitude, const double * altitude,
+    double * field, double ** workspace);
+
+/**
+ * Policies for locations outside of the validity domain of a model.
+ */
+enum gull_domain_policy {
+        /** Compute the field anyway, as for `gull_snapshot_field_v`. */
+        GULL_DOMAIN_COMPUTE = 0,
+        /** Compute the field at the closest valid altitude. */
+        GULL_DOMAIN_CLAMP,
+        /** Set the field components to NaN. */
+        GULL_DOMAIN_NAN,
+        /** The number of domain policies. */
+        GULL_N_DOMAIN_POLICIES
+};
+
+/**
+ * Compute the geomagnetic field for a batch of locations, with validity flags.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param n            The number of locations.
+ * @param latitude     The geodetic latitudes (deg).
+ * @param longitude    The geodetic longitudes (deg).
+ * @param altitude     The altitudes (m) above the reference ellipsoid (WGS84).
+ * @param policy       The policy for invalid locations.
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param valid        The validity bitmask of the locations, or `NULL`.
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_field_v` except that invalid
+ * locations, i.e. with an altitude outside of the validity range of the
+ * snapshot, are not reported as an error. Instead, they are flagged in
+ * *valid*, if not `NULL`, and the field is computed according to *policy*.
+ * Bit i % 8 of byte i / 8 of *valid* is set if location i is valid, i.e.
+ * *valid* must hold (*n* + 7) / 8 bytes.
+ *
+ * Altitudes are checked by groups of 8 locations, without branches.
+ * Thus, checking the validity costs about the same whatever the locations.
+ * Locations are processed by chunks of 256. The policy only applies to
+ * chunks holding invalid locations, which are otherwise computed as for
+ * `gull_snapshot_field_v`. Note that a NaN altitude is invalid, and it is
+ * not clamped.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided policy is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_checked(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, enum gull_domain_policy policy, double * field,
+    unsigned char * valid, double ** workspace);
+
+/**
+ * Compute the geomagnetic field at a given location, in single precision.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_field` except that all
+ * computations are done in single precision, using a single precision copy of
+ * the snapshot coefficients. The altitude is checked in double precision.
+ *
+ * Compared to `gull_snapshot_field`, the field components differ by less than
+ * 0.06 nT, i.e. a relative difference of 1E-06, for the IGRF13 and WMM2020
+ * data sets, worldwide and for altitudes from 0 up to 600 km. This includes
+ * locations close to the poles, where the latitude is clamped to +-89.999 deg
+ * as in double precision. There, differences are below 0.05 nT. Note that
+ * geodetic coordinates are resolved to about 1 m, in single precision.
+ *
+ * Rounding errors grow with the order of the snapshot, e.g. up to a relative
+ * difference of 4E-04 at order 170 for a synthetic model with a flat power
+ * spectrum. Above order 180, the single precision Legendre functions would
+ * underflow. Thus, the field is computed in double precision instead, as by
+ * `gull_snapshot_field`, and rounded to single precision.
+ *
+ * The temporary workspace is managed as for `gull_snapshot_field`, and it can
+ * be shared with double precision functions.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_float(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, float field[3],
+    double ** workspace);
+
+/**
+ * Compute the geomagnetic field for a batch of locations, in single precision.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param n            The number of locations.
+ * @param latitude     The geodetic latitudes (deg).
+ * @param longitude    The geodetic longitudes (deg).
+ * @param altitude     The altitudes (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This is a vectorised version of `gull_snapshot_field_float`, with the same
+ * conventions than `gull_snapshot_field_v`. Since a vector holds twice as
+ * many floats as doubles, locations are evaluated by groups of 16, e.g. as a
+ * single AVX-512 register. Up to order 180, the results are bit identical to
+ * `gull_snapshot_field_float`, with the same caveat as for
+ * `gull_snapshot_field_v` regarding floating point contraction. Above, they
+ * are computed in double precision as by `gull_snapshot_field_v`, and rounded
+ * to single precision.
+ *
+ * For IGRF13, this is about twice as fast as `gull_snapshot_field_v`, both for
+ * the spherical harmonics and for the conversion to geocentric coordinates.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    Some provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_float_v(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, float * field, double ** workspace);
+
+/**
+ * Compute the geomagnetic field over a block of rows of a regular map.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param altitude     The altitude (m) of the map above the reference
+ * ellipsoid (WGS84).
+ * @param latitude     The geodetic latitudes (deg) of the first and last rows.
+ * @param n_latitude   The total number of rows, i.e. of latitude nodes.
+ * @param longitude    The geodetic longitudes (deg) of the first and last
+ * columns.
+ * @param n_longitude  The number of columns, i.e. of longitude nodes.
+ * @param row          The index of the first row to compute.
+ * @param n_rows       The number of rows to compute.
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * The map nodes are regularly spaced, including both bounds of *latitude* and
+ * *longitude*. Rows *row* to *row* + *n_rows* - 1 are computed, which allows
+ * to generate a large map by blocks, e.g. for streaming it to a file. The
+ * *field* array must hold 3 * *n_rows* * *n_longitude* values. It is filled
+ * row by row, the components of node (i, j) of the block starting at index
+ * 3 * (i * *n_longitude* + j).
+ *
+ * Rows are computed in parallel when the library is built with OpenMP
+ * support, and each row is vectorised as for `gull_snapshot_field_v`. The
+ * temporary workspaces are managed internally.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude or block of rows is
+ * not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * allocated.
+ */
+enum gull_return gull_snapshot_field_map(struct gull_snapshot * snapshot,
+    double altitude, const double latitude[2], int n_latitude,
+    const double longitude[2], int n_longitude, int row, int n_rows,
+    double * field);
+
+/**
+ * Quantities derived from the geomagnetic field.
+ *
+ * These are flags, to be combined with a bitwise or, for selecting the
+ * quantities computed by `gull_snapshot_field_derived`. The selected
+ * quantities are returned in the order of this enumeration.
+ */
+enum gull_quantity {
+        /** The East component of the field (T). */
+        GULL_QUANTITY_EAST = 0x1,
+        /** The North component of the field (T). */
+        GULL_QUANTITY_NORTH = 0x2,
+        /** The Upward component of the field (T). */
+        GULL_QUANTITY_UP = 0x4,
+        /** The declination (deg), positive eastwards. */
+        GULL_QUANTITY_DECLINATION = 0x8,
+        /** The inclination (deg), positive downwards. */
+        GULL_QUANTITY_INCLINATION = 0x10,
+        /** The horizontal intensity, H (T). */
+        GULL_QUANTITY_H = 0x20,
+        /** The total intensity, F (T). */
+        GULL_QUANTITY_F = 0x40,
+        /** The grid variation (deg), at polar latitudes. */
+        GULL_QUANTITY_GRID = 0x80,
+        /** The number of derived quantities. */
+        GULL_N_QUANTITIES = 8
+};
+
+/**
+ * Compute quantities derived from the geomagnetic field.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param quantities   The requested quantities, as `gull_quantity` flags.
+ * @param values       The corresponding values.
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_snapshot_field` except that only the
+ * requested *quantities* are returned, packed in the order of the
+ * `gull_quantity` enumeration. Thus, *values* must hold as many values as
+ * selected flags.
+ *
+ * The grid variation is defined as for the WMM, i.e. it is the declination
+ * minus the longitude north of 55 deg N, or plus the longitude south of
+ * 55 deg S. It is set to `NAN` at lower latitudes.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude or quantities are not
+ * valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_derived(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude,
+    unsigned int quantities, double * values, double ** workspace);
+
+/**
+ * Compute quantities derived from the geomagnetic field, for a batch of
+ * locations.
+ *
+ * @param snapshot     A handle to the snapshot.
+ * @param n            The number of locations.
+ * @param latitude     The geodetic latitudes (deg).
+ * @param longitude    The geodetic longitudes (deg).
+ * @param altitude     The altitudes (m) above the reference ellipsoid (WGS84).
+ * @param quantities   The requested quantities, as `gull_quantity` flags.
+ * @param values       The corresponding values.
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This is a vectorised version of `gull_snapshot_field_derived`. The values
+ * of location i start at index i * k, where k is the number of requested
+ * quantities. The field components are evaluated as for
+ * `gull_snapshot_field_v`, by chunks, thus they are not stored for the whole
+ * batch unless requested.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    Some provided altitude or the quantities
+ * are not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ */
+enum gull_return gull_snapshot_field_derived_v(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, unsigned int quantities, double * values,
+    double ** workspace);
+
+/**
+ * Size of the temporary workspace.
+ *
+ * @param snapshot    A handle to the snapshot.
+ * @return The size of the workspace, in bytes.
+ *
+ * Get the size of the temporary workspace required for evaluating the field
+ * of *snapshot*, e.g. with `gull_snapshot_field_buffer`.
+ */
+size_t gull_snapshot_workspace_size(struct gull_snapshot * snapshot);
+
+/**
+ * Export the coefficients of a snapshot by columns.
+ *
+ * @param snapshot    A handle to the snapshot.
+ * @param columns     The exported columns, or `NULL`.
+ * @return The number of doubles of the columns.
+ *
+ * Export the spherical harmonic coefficients of *snapshot* grouped by order m,
+ * e.g. for evaluating the field with the inline kernel of gull-kernel.h. If
+ * *columns* is `NULL`, only the required size is returned.
+ *
+ * The columns are four arrays of *npq* = *order* (*order* + 3) / 2 values,
+ * stored contiguously: the g and h coefficients, in nT, and the two recursion
+ * constants of the associated Legendre functions, at offsets 0, *npq*,
+ * 2 *npq* and 3 *npq*. Column m holds the terms of degree n in
+ * [max(m, 1), *order*], by increasing degree, and columns are stored by
+ * increasing m. Sectoral terms (n = m) only use the first constant.
+ */
+size_t gull_snapshot_columns(struct gull_snapshot * snapshot, double * columns);
+
+/**
+ * Information on a geomagnetic snapshot.
+ *
+ * @param snapshot        A handle to the snapshot.
+ * @param order           The order used for spherical harmonics.
+ * @param altitude_min    The minimum altitude (m) at which the model is valid.
+ * @param altitude_max    The maximum altitude (m) at which the model is valid.
+ *
+ * Get some basic information on a geomagnetic snapshot. Note that any output
+ * parameter can be set to `NULL` if the corresponding property is not needed.
+ */
+void gull_snapshot_info(struct gull_snapshot * snapshot, int * order,
+    double * altitude_min, double * altitude_max);
+
+/**
+ * Opaque structure for handling time dependent geomagnetic models.
+ */
+struct gull_model;
+
+/**
+ * Create a time dependent geomagnetic model.
+ *
+ * @param model      A handle to the model.
+ * @param path       The file containing the geomagnetic model data.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Load all the data sets, i.e. epochs, of a geomagnetic model from *path*.
+ * Snapshots of the model can then be obtained at any valid date, without
+ * reading the data file again, using `gull_model_snapshot`. The supported data
+ * formats are the same as for `gull_snapshot_create`.
+ *
+ * Binary data files are memory mapped read only, if supported by the OS. Thus
+ * loading them is almost free, and the page cache is shared between all the
+ * processes using the same file.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_FORMAT_ERROR     The data file has a wrong format.
+ *
+ *     GULL_RETURN_MEMORY_ERROR     Couldn't allocate memory.
+ *
+ *     GULL_RETURN_MISSING_DATA     The data file contains no data set.
+ *
+ *     GULL_RETURN_PATH_ERROR       The data file couldn't be found/opened.
+ */
+enum gull_return gull_model_create(
+    struct gull_model ** model, const char * path);
+
+/**
+ * Create a builtin geomagnetic model.
+ *
+ * @param model      A handle to the model.
+ * @param name       The name of the builtin model, or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Get a geomagnetic model compiled in the library, without any file access.
+ * The available models are `IGRF13` and `WMM2020`. If *name* is `NULL` the
+ * first builtin model, i.e. `IGRF13`, is returned. Note that builtin models
+ * are only available if the library was built with `EMBED_MODELS=1`.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_MEMORY_ERROR     Couldn't allocate memory.
+ *
+ *     GULL_RETURN_MISSING_DATA     There is no such builtin model.
+ */
+enum gull_return gull_model_create_builtin(
+    struct gull_model ** model, const char * name);
+
+/**
+ * Destroy a geomagnetic model.
+ *
+ * @param model      A handle to the model.
+ *
+ * Fully destroy a model and free any allocated memory. Note that snapshots
+ * obtained from the model remain valid.
+ */
+void gull_model_destroy(struct gull_model ** model);
+
+/**
+ * Dump a geomagnetic model to a binary file.
+ *
+ * @param model      A handle to the model.
+ * @param path       The output file.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Write the model data to *path* in a compact binary format. The resulting
+ * file can be loaded with `gull_model_create` or `gull_snapshot_create` in
+ * place of the source data file, without any parsing. Note that binary files
+ * use the native byte order. They are not portable across architectures.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_PATH_ERROR       The file couldn't be opened or written.
+ */
+enum gull_return gull_model_dump(struct gull_model * model, const char * path);
+
+/**
+ * Get a snapshot of a geomagnetic model.
+ *
+ * @param model      A handle to the model.
+ * @param date       The date, as a decimal year, e.g. 2020.5.
+ * @param snapshot   A handle to the snapshot.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Compute a snapshot of *model* at the given *date*, by interpolating or
+ * extrapolating its data sets as `gull_snapshot_create` does. If *snapshot*
+ * points to an existing snapshot, e.g. from a previous call, its memory is
+ * reused. Otherwise, *snapshot* must point to `NULL` and a new snapshot is
+ * allocated. In both cases, the snapshot must be released with
+ * `gull_snapshot_destroy`. On failure, *snapshot* is left unchanged.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_MEMORY_ERROR     Couldn't allocate memory.
+ *
+ *     GULL_RETURN_MISSING_DATA     There is no valid data for the
+ * requested date.
+ */
+enum gull_return gull_model_snapshot(
+    struct gull_model * model, double date, struct gull_snapshot ** snapshot);
+
+/**
+ * Compute the geomagnetic field of a model at a given date.
+ *
+ * @param model        A handle to the model.
+ * @param date         The date, as a decimal year, e.g. 2020.5.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Compute the geomagnetic field components in East, North, Upward (ENU) at a
+ * given location on Earth and at the given *date*. The time interpolation, or
+ * extrapolation, of the model is folded into the spherical harmonic sum. Thus,
+ * no snapshot is needed. The temporary *workspace* is managed as for
+ * `gull_snapshot_field`.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ *
+ *     GULL_RETURN_MISSING_DATA    There is no valid data for the
+ * requested date.
+ */
+enum gull_return gull_model_field(struct gull_model * model, double date,
+    double latitude, double longitude, double altitude, double field[3],
+    double ** workspace);
+
+/**
+ * Compute the geomagnetic field of a model and its secular variation.
+ *
+ * @param model        A handle to the model.
+ * @param date         The date, as a decimal year.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param rate         The time derivative of the field components (T/year).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This function is equivalent to `gull_model_field` except that the time
+ * derivative of the field is returned as well, in a single pass over the
+ * spherical harmonics. Since the coefficients are linear in time within an
+ * epoch interval, the derivative is constant over the interval, at a given
+ * location.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ *
+ *     GULL_RETURN_MISSING_DATA    There is no valid data for the
+ * requested date.
+ */
+enum gull_return gull_model_field_rate(struct gull_model * model, double date,
+    double latitude, double longitude, double altitude, double field[3],
+    double rate[3], double ** workspace);
+
+/**
+ * Compute the geomagnetic field of a model for a batch of dates and locations.
+ *
+ * @param model        A handle to the model.
+ * @param n            The number of dates and locations.
+ * @param date         The dates, as decimal years.
+ * @param latitude     The geodetic latitudes (deg).
+ * @param longitude    The geodetic longitudes (deg).
+ * @param altitude     The altitudes (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @param workspace    A pointer to the temporary worspace or `NULL`.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This is a vectorised version of `gull_model_field`. The arrays are laid out
+ * as for `gull_snapshot_field_v`. Successive points within the same epoch
+ * interval are evaluated without any search over epochs, thus sorting the
+ * points by date is beneficial. In addition, groups of 8 successive points
+ * within the same epoch interval are vectorised, as for
+ * `gull_snapshot_field_v`.
+ *
+ * The field is computed for all points with valid data, including points with
+ * an invalid altitude. Points without valid data get a null field. A single
+ * error is reported, for the first invalid point, once the whole batch has
+ * been processed.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    Some provided altitude is not valid.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The temporary workspace could not be
+ * (re)allocated.
+ *
+ *     GULL_RETURN_MISSING_DATA    There is no valid data for some
+ * requested date.
+ */
+enum gull_return gull_model_field_v(struct gull_model * model, int n,
+    const double * date, const double * latitude, const double * longitude,
+    const double * altitude, double * field, double ** workspace);
+
+/**
+ * Size of the temporary workspace of a model.
+ *
+ * @param model    A handle to the model.
+ * @return The size of the workspace, in bytes.
+ *
+ * Get the size of the temporary workspace required for evaluating the field
+ * of *model*, at any date.
+ */
+size_t gull_model_workspace_size(struct gull_model * model);
+
+/**
+ * Information on a geomagnetic model.
+ *
+ * @param model        A handle to the model.
+ * @param order        The maximum order used for spherical harmonics.
+ * @param date_min     The minimum date at which the model is valid.
+ * @param date_max     The maximum date at which the model is valid.
+ *
+ * Get some basic information on a geomagnetic model. Dates are given as
+ * decimal years. Note that any output parameter can be set to `NULL` if the
+ * corresponding property is not needed.
+ */
+void gull_model_info(struct gull_model * model, int * order,
+    double * date_min, double * date_max);
+
+/**
+ * Opaque structure for handling precomputed grids of the geomagnetic field.
+ */
+struct gull_grid;
+
+/**
+ * Precompute the geomagnetic field of a snapshot over a grid.
+ *
+ * @param grid         A handle to the grid.
+ * @param snapshot     A handle to the snapshot.
+ * @param latitude     The geodetic latitude range (deg).
+ * @param longitude    The geodetic longitude range (deg).
+ * @param altitude     The altitude range (m) above the reference ellipsoid.
+ * @param resolution   The requested latitude (deg), longitude (deg) and
+ * altitude (m) steps.
+ * @param tolerance    The maximum interpolation error (T), or 0.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * Tabulate the field of *snapshot* over a regular grid spanning the given
+ * box, for subsequent fast lookups with `gull_grid_field`. The steps are
+ * adjusted downwards such that the box contains an integer number of cells.
+ * The longitude range can span up to 360 deg, and it can start at any value.
+ *
+ * If *tolerance* is strictly positive, the interpolation error is estimated at
+ * the centre of each cell, as the norm of the difference to the exact field.
+ * If the maximum error exceeds *tolerance*, the grid is discarded and an error
+ * is returned. Note that the estimate is not an upper bound, though it is
+ * usually close to one for smooth fields. Checking the tolerance costs about
+ * as much as computing the grid.
+ *
+ * The grid is computed in parallel when the library is built with OpenMP
+ * support. The snapshot is not referenced by the grid, i.e. it can be
+ * destroyed once the grid has been created.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    Some range or resolution is not valid, or
+ * the interpolation error exceeds the tolerance.
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The grid could not be allocated.
+ */
+enum gull_return gull_grid_create(struct gull_grid ** grid,
+    struct gull_snapshot * snapshot, const double latitude[2],
+    const double longitude[2], const double altitude[2],
+    const double resolution[3], double tolerance);
+
+/**
+ * Destroy a geomagnetic grid.
+ *
+ * @param grid    A handle to the grid.
+ *
+ * Fully destroy a grid and free any allocated memory. Note that a `NULL`
+ * value is set to *grid* on exit.
+ */
+void gull_grid_destroy(struct gull_grid ** grid);
+
+/**
+ * Interpolate the geomagnetic field from a grid.
+ *
+ * @param grid         A handle to the grid.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param magnet       The corresponding magnetic field E, N, U components (T).
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * The field is interpolated trilinearly from the grid nodes. No temporary
+ * workspace is needed, thus a grid can be shared between threads. Longitudes
+ * are wrapped modulo 360 deg.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The location is outside of the grid. The
+ * field is set to zero.
+ */
+enum gull_return gull_grid_field(struct gull_grid * grid, double latitude,
+    double longitude, double altitude, double magnet[3]);
+
+/**
+ * Information on a geomagnetic grid.
+ *
+ * @param grid         A handle to the grid.
+ * @param latitude     The latitude range of the grid (deg).
+ * @param longitude    The longitude range of the grid (deg).
+ * @param altitude     The altitude range of the grid (m).
+ * @param error        The estimated interpolation error (T).
+ *
+ * The error is -1 if it was not estimated, i.e. if the grid was created
+ * with a null tolerance. Note that any output parameter can be set to `NULL`
+ * if the corresponding property is not needed.
+ */
+void gull_grid_info(struct gull_grid * grid, double latitude[2],
+    double longitude[2], double altitude[2], double * error);
+
+/**
+ * Opaque structure for evaluating the geomagnetic field along tracks.
+ */
+struct gull_track;
+
+/**
+ * Create a track for evaluating the field at successive locations.
+ *
+ * @param track        A handle to the track.
+ * @param snapshot     A handle to the snapshot.
+ * @param tolerance    The tolerance on the expansion error (T), or 0.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * A track speeds up the evaluation of the field at closely spaced successive
+ * locations, e.g. the steps of a particle track, see `gull_track_field`. The
+ * snapshot is referenced by the track, i.e. it must not be destroyed before
+ * the track. A track holds its own temporary workspace, and it must not be
+ * shared between threads.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_MEMORY_ERROR    The track could not be allocated.
+ */
+enum gull_return gull_track_create(struct gull_track ** track,
+    struct gull_snapshot * snapshot, double tolerance);
+
+/**
+ * Destroy a track.
+ *
+ * @param track    A handle to the track.
+ *
+ * Fully destroy a track and free any allocated memory. Note that a `NULL`
+ * value is set to *track* on exit.
+ */
+void gull_track_destroy(struct gull_track ** track);
+
+/**
+ * Compute the geomagnetic field at the next location of a track.
+ *
+ * @param track        A handle to the track.
+ * @param latitude     The geodetic latitude (deg).
+ * @param longitude    The geodetic longitude (deg).
+ * @param altitude     The altitude (m) above the reference ellipsoid (WGS84).
+ * @param field        The corresponding magnetic field E, N, U components (T).
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * The track keeps an anchor location, where the field and its gradient are
+ * computed as with `gull_snapshot_field_gradient`. Close to the anchor, the
+ * field is expanded to first order, which is about 40 times faster than
+ * `gull_snapshot_field`. The anchor is moved to the requested location when
+ * the estimated error of the expansion is not below *tolerance*. Thus, a null
+ * tolerance results in exact evaluations.
+ *
+ * The error estimate is an upper bound on the second order terms, derived
+ * from the power spectrum of the snapshot. For IGRF13 at ground level and a
+ * tolerance of 1 nT, the anchor is moved every few km, and the actual error is
+ * about 4 times lower than the tolerance. Close to the poles, the local frame
+ * rotates faster, thus the anchor is moved more often. Note that successive
+ * locations need not be close, though the expansion only pays off if they are.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR    The provided altitude is not valid.
+ */
+enum gull_return gull_track_field(struct gull_track * track, double latitude,
+    double longitude, double altitude, double field[3]);
+
+/**
+ * Reset a track.
+ *
+ * @param track    A handle to the track.
+ *
+ * Discard the anchor of the track, e.g. when starting a new track. The next
+ * location is then computed exactly.
+ */
+void gull_track_reset(struct gull_track * track);
+
+/**
+ * Information on a track.
+ *
+ * @param track        A handle to the track.
+ * @param tolerance    The tolerance on the expansion error (T).
+ * @param n_steps      The number of evaluated locations.
+ * @param n_anchors    The number of anchors, i.e. of exact evaluations.
+ *
+ * Note that any output parameter can be set to `NULL` if the corresponding
+ * property is not needed.
+ */
+void gull_track_info(struct gull_track * track, double * tolerance,
+    long * n_steps, long * n_anchors);
+
+/**
+ * Convert a calendar date to a decimal year.
+ *
+ * @param day        The day in the month, i.e. in [1,31].
+ * @param month      The month of the year, i.e. in [1, 12].
+ * @param year       The year number, e.g. 2018.
+ * @param date       The corresponding decimal year.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * This is the conversion used by `gull_snapshot_create`.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_DOMAIN_ERROR     The provided date is not valid.
+ */
+enum gull_return gull_date_decimal(
+    int day, int month, int year, double * date);
+
+/**
+ * Usage statistics of the library.
+ *
+ * Statistics are collected for the calling thread, if the library was compiled
+ * with `GULL_STATS` defined, e.g. with `make STATS=1`. Otherwise, they are
+ * compiled out and cost nothing.
+ */
+struct gull_stats {
+        /** The number of calls to field functions of snapshots and models. */
+        unsigned long long field_calls;
+        /** The number of points at which the field was evaluated. */
+        unsigned long long field_points;
+        /**
+         * The number of domain errors raised, e.g. for out of range altitudes.
+         * Note that a single error is raised per call, whatever the number of
+         * points out of range, see `domain_points`.
+         */
+        unsigned long long domain_errors;
+        /**
+         * The number of points out of the altitude range of the snapshot or
+         * model, counted per point, including by `gull_snapshot_field_checked`
+         * whatever the policy.
+         */
+        unsigned long long domain_points;
+        /** The number of workspace (re)allocations. */
+        unsigned long long workspace_allocations;
+        /** The number of snapshots created, e.g. from data files or models. */
+        unsigned long long snapshot_creations;
+        /** The number of bytes parsed from COF data files. */
+        unsigned long long bytes_parsed;
+        /** The time spent in creating snapshots, in s. */
+        double create_time;
+        /** The time spent in evaluating the field, in s. */
+        double evaluation_time;
+};
+
+/**
+ * Get the usage statistics of the current thread.
+ *
+ * @param stats      The statistics.
+ * @return On success `GULL_RETURN_SUCCESS` is returned otherwise an error
+ * code is returned as detailed below.
+ *
+ * The statistics are accumulated since the start of the thread, or since the
+ * last call to `gull_stats_reset`. Times are wall clock times, when POSIX is
+ * available. Note that with OpenMP, the workspaces of grids and maps are
+ * allocated by worker threads, and thus counted in the statistics of these
+ * threads.
+ *
+ * __Error codes__
+ *
+ *     GULL_RETURN_MISSING_DATA     The library was compiled without
+ * statistics.
+ */
+enum gull_return gull_stats_get(struct gull_stats * stats);
+
+/**
+ * Reset the usage statistics of the current thread.
+ */
+void gull_stats_reset(void);
+
+/**
+ * Return a string describing a GULL library function.
+ *
+ * @param function    The library function.
+ * @return a static string.
+ *
+ * This function is meant for verbosing when handling errors.
+ */
+const char * gull_error_function(gull_function_t * function);
+
+/**
+ * Get the current error handler.
+ *
+ * @return The current error handler or `NULL` if none.
+ */
+gull_handler_cb * gull_error_handler_get(void);
+
+/**
+ * Set or clear the error handler.
+ *
+ * @param handler    The error handler to set or `NULL`.
+ *
+ * Set the error handler callback for GULL library functions. If *handler* is
+ * set to `NULL` error callbacks are disabled.
+ *
+ * __Warnings__
+ *
+ * This function is **not** thread safe.
+ */
+void gull_error_handler_set(gull_handler_cb * handler);
+
+/**
+ * Get the error handler of the current thread.
+ *
+ * @return The current thread's error handler or `NULL` if none.
+ */
+gull_handler_cb * gull_error_handler_get_local(void);
+
+/**
+ * Set or clear the error handler of the current thread.
+ *
+ * @param handler    The error handler to set or `NULL`.
+ *
+ * Set an error handler callback specific to the calling thread. If not `NULL`,
+ * it overrides the global error handler, set with `gull_error_handler_set`,
+ * for GULL library functions called from this thread. If *handler* is set to
+ * `NULL` the global error handler is used again.
+ *
+ * Error messages are only formated if an error handler is in effect. Thus,
+ * errors cost no more than returning an error code if no handler is set.
+ * Note that the *message* provided to the handler lives in a per thread
+ * buffer. It is overwritten by subsequent errors.
+ *
+ * This function is thread safe.
+ */
+void gull_error_handler_set_local(gull_handler_cb * handler);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -18,40 +18,176 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(GULL_NO_MMAP)
+/* Memory map binary model files, using POSIX. */
+#define GULL_USE_MMAP
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(GULL_NO_PTHREAD)
+/* Lock the cache of shared snapshots, using POSIX threads. */
+#define GULL_USE_PTHREAD
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
+#if (defined(__unix__) || defined(__APPLE__)) && defined(GULL_STATS)
+/* Time the library calls with a monotonic clock, using POSIX. */
+#define GULL_USE_CLOCK_GETTIME
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
 #include "gull.h"
 /* C89 standard library */
 #include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+/* C99 standard library */
+#include <stdint.h>
+#ifdef GULL_USE_MMAP
+/* POSIX */
+#include <sys/mman.h>
+#endif
+#ifdef GULL_USE_PTHREAD
+/* POSIX */
+#include <pthread.h>
+#endif
 
 #ifndef M_PI
 /* Define pi, if unknown. */
 #define M_PI 3.14159265358979323846
 #endif
 
+#if defined(__GNUC__)
+/* Force inlining, e.g. for specialising kernels at compile time. */
+#define GULL_INLINE inline __attribute__((always_inline))
+#else
+#define GULL_INLINE inline
+#endif
+
+#if defined(__clang__)
+/* Hint for unrolling loops, e.g. in specialised kernels. */
+#define GULL_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && (__GNUC__ >= 8)
+#define GULL_UNROLL _Pragma("GCC unroll 16")
+#else
+#define GULL_UNROLL
+#endif
+
+#if defined(_MSC_VER)
+#define GULL_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) &&           \
+    !defined(__STDC_NO_THREADS__)
+#define GULL_THREAD_LOCAL _Thread_local
+#else
+#define GULL_THREAD_LOCAL __thread
+#endif
+
+#ifdef GULL_STATS
+/* The usage statistics of the current thread. */
+static GULL_THREAD_LOCAL struct gull_stats _stats;
+
+/* Utility function for reading the time, in s. */
+static double stats_clock(void)
+{
+#ifdef GULL_USE_CLOCK_GETTIME
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1E-09 * ts.tv_nsec;
+#else
+        return clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+/* Helper macros for collecting statistics. */
+#define STATS_ADD(counter, n) (_stats.counter += (n))
+#define STATS_START() const double stats_start_ = stats_clock()
+#define STATS_STOP(timer) (_stats.timer += stats_clock() - stats_start_)
+
+/*
+ * Count the points of a batch with an altitude out of [altmin, altmax], in
+ * km, as checked by the field functions.
+ */
+static void stats_domain(
+    int n, const double * altitude, double altmin, double altmax)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                const double z = altitude[i] * 1E-03; /* m -> km. */
+                if ((z < altmin) || (z > altmax)) _stats.domain_points++;
+        }
+}
+#define STATS_DOMAIN(n, altitude, altmin, altmax)                              \
+        stats_domain(n, altitude, altmin, altmax)
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_START() ((void)0)
+#define STATS_STOP(timer) ((void)0)
+#define STATS_DOMAIN(n, altitude, altmin, altmax) ((void)0)
+#endif
+
+/* Record a call to a field function, over *n* points. */
+#define STATS_FIELD(n)                                                         \
+        (STATS_ADD(field_calls, 1), STATS_ADD(field_points, n),                \
+            STATS_STOP(evaluation_time))
+
 /* The user supplied error handler, if any. */
 static gull_handler_cb * _handler;
 
+/* The user supplied error handler for the current thread, if any. */
+static GULL_THREAD_LOCAL gull_handler_cb * _local_handler;
+
 /* Getter for the error handler. */
 gull_handler_cb * gull_error_handler_get(void) { return _handler; }
 
 /* Setter for the error handler. */
 void gull_error_handler_set(gull_handler_cb * handler) { _handler = handler; }
 
+/* Getter for the error handler of the current thread. */
+gull_handler_cb * gull_error_handler_get_local(void) { return _local_handler; }
+
+/* Setter for the error handler of the current thread. */
+void gull_error_handler_set_local(gull_handler_cb * handler)
+{
+        _local_handler = handler;
+}
+
+/* The error handler in effect for the current thread, if any. */
+static inline gull_handler_cb * error_handler(void)
+{
+        return (_local_handler != NULL) ? _local_handler : _handler;
+}
+
+/*
+ * Error context of an API function. Note that it does not embed the error
+ * message, in order to keep its initialisation cheap.
+ */
 struct error_context {
         enum gull_return code;
         gull_function_t * function;
-#define ERROR_MSG_LENGTH 1024
-        char message[ERROR_MSG_LENGTH];
 };
 
+/*
+ * Per thread buffer for error messages. It is only written to if an error
+ * handler is in effect.
+ */
+#define ERROR_MSG_LENGTH 1024
+static GULL_THREAD_LOCAL char _message[ERROR_MSG_LENGTH];
+
 /* Helper macros for returning an encapsulated error code. */
 #define GULL_ERROR_INITIALISE(caller)                                          \
-        struct error_context error_data = { .function =                        \
-                                                (gull_function_t *)caller };   \
+        struct error_context error_data = { GULL_RETURN_SUCCESS,               \
+                (gull_function_t *)caller };                                   \
         struct error_context * error_ = &error_data;
 
 #define GULL_ERROR_MESSAGE(rc, message)                                        \
@@ -70,22 +206,26 @@ struct error_context {
 
 #define GULL_ERROR_RAISE() error_raise(error_)
 
-/* Utility function for formating errors. */
+/*
+ * Utility function for formating errors. The message is formated only if an
+ * error handler is in effect.
+ */
 static enum gull_return error_format(struct error_context * context,
     enum gull_return rc, const char * file, int line, const char * format, ...)
 {
         context->code = rc;
-        if ((_handler == NULL) || (rc == GULL_RETURN_SUCCESS)) return rc;
+        if (rc == GULL_RETURN_DOMAIN_ERROR) STATS_ADD(domain_errors, 1);
+        if ((rc == GULL_RETURN_SUCCESS) || (error_handler() == NULL))
+                return rc;
 
         /* Format the error message */
         const int n =
-            snprintf(context->message, ERROR_MSG_LENGTH, "{ %s [#%d], %s:%d } ",
+            snprintf(_message, ERROR_MSG_LENGTH, "{ %s [#%d], %s:%d } ",
                 gull_error_function(context->function), rc, file, line);
         if (n < ERROR_MSG_LENGTH - 1) {
                 va_list ap;
                 va_start(ap, format);
-                vsnprintf(
-                    context->message + n, ERROR_MSG_LENGTH - n, format, ap);
+                vsnprintf(_message + n, ERROR_MSG_LENGTH - n, format, ap);
                 va_end(ap);
         }
 
@@ -95,8 +235,10 @@ static enum gull_return error_format(struct error_context * context,
 /* Utility function for handling errors. */
 static enum gull_return error_raise(struct error_context * context)
 {
-        if ((_handler != NULL) && (context->code != GULL_RETURN_SUCCESS))
-                _handler(context->code, context->function, context->message);
+        if (context->code == GULL_RETURN_SUCCESS) return context->code;
+        gull_handler_cb * handler = error_handler();
+        if (handler != NULL)
+                handler(context->code, context->function, _message);
         return context->code;
 }
 
@@ -108,19 +250,78 @@ const char * gull_error_function(gull_function_t * caller)
 
         /* API functions with error codes. */
         REGISTER_FUNCTION(gull_snapshot_create)
+        REGISTER_FUNCTION(gull_snapshot_create_shared)
         REGISTER_FUNCTION(gull_snapshot_field)
+        REGISTER_FUNCTION(gull_snapshot_field_v)
+        REGISTER_FUNCTION(gull_snapshot_field_checked)
+        REGISTER_FUNCTION(gull_snapshot_field_float)
+        REGISTER_FUNCTION(gull_snapshot_field_float_v)
+        REGISTER_FUNCTION(gull_snapshot_field_truncated)
+        REGISTER_FUNCTION(gull_snapshot_field_map)
+        REGISTER_FUNCTION(gull_snapshot_field_derived)
+        REGISTER_FUNCTION(gull_snapshot_field_derived_v)
+        REGISTER_FUNCTION(gull_snapshot_field_buffer)
+        REGISTER_FUNCTION(gull_snapshot_field_ecef)
+        REGISTER_FUNCTION(gull_snapshot_field_gradient)
+        REGISTER_FUNCTION(gull_snapshot_field_rate)
+        REGISTER_FUNCTION(gull_model_create)
+        REGISTER_FUNCTION(gull_model_snapshot)
+        REGISTER_FUNCTION(gull_model_dump)
+        REGISTER_FUNCTION(gull_model_create_builtin)
+        REGISTER_FUNCTION(gull_model_field)
+        REGISTER_FUNCTION(gull_model_field_v)
+        REGISTER_FUNCTION(gull_model_field_rate)
+        REGISTER_FUNCTION(gull_grid_create)
+        REGISTER_FUNCTION(gull_grid_field)
+        REGISTER_FUNCTION(gull_track_create)
+        REGISTER_FUNCTION(gull_track_field)
+        REGISTER_FUNCTION(gull_date_decimal)
+        REGISTER_FUNCTION(gull_stats_get)
 
         /* Other API functions. */
         REGISTER_FUNCTION(gull_snapshot_destroy)
         REGISTER_FUNCTION(gull_snapshot_info)
+        REGISTER_FUNCTION(gull_snapshot_workspace_size)
+        REGISTER_FUNCTION(gull_snapshot_columns)
+        REGISTER_FUNCTION(gull_model_destroy)
+        REGISTER_FUNCTION(gull_model_info)
+        REGISTER_FUNCTION(gull_model_workspace_size)
+        REGISTER_FUNCTION(gull_grid_destroy)
+        REGISTER_FUNCTION(gull_grid_info)
+        REGISTER_FUNCTION(gull_track_destroy)
+        REGISTER_FUNCTION(gull_track_reset)
+        REGISTER_FUNCTION(gull_track_info)
+        REGISTER_FUNCTION(gull_stats_reset)
         REGISTER_FUNCTION(gull_error_function)
         REGISTER_FUNCTION(gull_error_handler_get)
         REGISTER_FUNCTION(gull_error_handler_set)
+        REGISTER_FUNCTION(gull_error_handler_get_local)
+        REGISTER_FUNCTION(gull_error_handler_set_local)
 
         return NULL;
 #undef REGISTER_FUNCTION
 }
 
+enum gull_return gull_stats_get(struct gull_stats * stats)
+{
+#ifdef GULL_STATS
+        *stats = _stats;
+        return GULL_RETURN_SUCCESS;
+#else
+        GULL_ERROR_INITIALISE(gull_stats_get);
+        memset(stats, 0x0, sizeof(*stats));
+        return GULL_ERROR_MESSAGE(
+            GULL_RETURN_MISSING_DATA, "statistics are not enabled");
+#endif
+}
+
+void gull_stats_reset(void)
+{
+#ifdef GULL_STATS
+        memset(&_stats, 0x0, sizeof(_stats));
+#endif
+}
+
 /* Utility function for converting a calendar date to a decimal year. */
 static enum gull_return date_decimal(
     int day, int month, int year, double * date, struct error_context * error_)
@@ -154,6 +355,13 @@ static enum gull_return date_decimal(
         return GULL_RETURN_SUCCESS;
 }
 
+/*
+ * The maximum supported order of the spherical harmonics. Above, the scaled
+ * recursion of the associated Legendre functions loses accuracy near the
+ * poles, see LEGENDRE_SCALE.
+ */
+#define ORDER_MAX 2700
+
 /* Low level data structure for hosting a snapshot of a geomagnetic model. */
 struct gull_snapshot {
         /* The order of the spherical harmonics. */
@@ -162,7 +370,16 @@ struct gull_snapshot {
         double altmin;
         /* The maximum allowed altitude, in km */
         double altmax;
-        /* The spherical harmonic coefficients. */
+        /* The cache entry of a shared snapshot, or NULL. */
+        struct snapshot_share * share;
+        /*
+         * The spherical harmonic coefficients, followed by the recursion
+         * constants for the associated Legendre functions, by the power
+         * spectrum and by the secular variation of the coefficients. A single
+         * precision copy of the coefficients and of the recursion constants
+         * is appended up to FLOAT_ORDER_MAX, followed by the columns of the
+         * coefficients above COLUMNS_ORDER.
+         */
         double coeff[];
 };
 
@@ -176,51 +393,363 @@ static inline double * get_coeff(struct gull_snapshot * snapshot, int i, int j)
         return snapshot->coeff + 2 * i * (i + 3) + 4 * j;
 }
 
-enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
-    const char * path, int day, int month, int year)
+/* Utility function for accessing the recursion constants of a snapshot. */
+static inline double * get_recursion(const struct gull_snapshot * snapshot)
 {
-        GULL_ERROR_INITIALISE(gull_snapshot_create);
-        *snapshot = NULL;
+        return (double *)snapshot->coeff +
+            snapshot->order * (snapshot->order + 3);
+}
 
-        /* Get the decimal year. */
-        double date;
-        enum gull_return rc;
-        if ((rc = date_decimal(day, month, year, &date, error_)) !=
-            GULL_RETURN_SUCCESS)
-                return GULL_ERROR_RAISE();
+/*
+ * Utility function for accessing the power spectrum of a snapshot, i.e. the
+ * Lowes-Mauersberger terms at the reference radius.
+ */
+static inline double * get_spectrum(const struct gull_snapshot * snapshot)
+{
+        const int order = snapshot->order;
+        return get_recursion(snapshot) + order * (order + 3);
+}
+
+/*
+ * Utility function for accessing the secular variation of the coefficients of
+ * a snapshot, per year.
+ */
+static inline double * get_slope(const struct gull_snapshot * snapshot)
+{
+        return get_spectrum(snapshot) + snapshot->order;
+}
+
+/*
+ * The maximum order of the single precision kernels. The Legendre recursions
+ * are not scaled in single precision. Thus, at high orders the sectoral terms
+ * underflow while the terms of higher degree that they seed do not vanish,
+ * e.g. at mid latitudes. This starts at orders of about 240, since P_mm
+ * scales as e^(-n / e) at the turning point. Above this order, the single
+ * precision functions compute the field in double precision instead, and
+ * round the result. Thus, the single precision copy of the coefficients
+ * is only stored up to this order.
+ */
+#define FLOAT_ORDER_MAX 180
+
+/* The size of the single precision copy of a snapshot, in number of floats. */
+static size_t float_size(int order)
+{
+        return (order <= FLOAT_ORDER_MAX) ? 2 * (size_t)order * (order + 3) :
+                                            0;
+}
+
+/*
+ * Utility function for accessing the single precision copy of the
+ * coefficients of a snapshot, followed by the one of the recursion constants.
+ */
+static inline const float * get_coeff_float(
+    const struct gull_snapshot * snapshot)
+{
+        const int order = snapshot->order;
+        return (const float *)(get_slope(snapshot) + order * (order + 3));
+}
+
+/*
+ * Copy the spherical harmonic coefficients and the recursion constants of a
+ * snapshot to single precision. Note that both are contiguous in the snapshot
+ * memory.
+ */
+static void float_initialise(struct gull_snapshot * snapshot)
+{
+        const size_t n = float_size(snapshot->order);
+        /* The snapshot is writable here, thus the cast is safe. */
+        float * const f = (float *)get_coeff_float(snapshot);
+        size_t i;
+        for (i = 0; i < n; i++) f[i] = (float)snapshot->coeff[i];
+}
+
+/*
+ * Layout of the columns of a snapshot, i.e. of its coefficients grouped by
+ * order m, for kernels looping over m first.
+ *
+ * Column m holds the terms of degree n in [max(m, 1), order], by increasing
+ * degree. The g and h coefficients and the two recursion constants of the
+ * associated Legendre functions are stored as four separate arrays, each
+ * aligned on COLUMNS_ALIGNMENT bytes. Sectoral terms (n = m) only use the
+ * first constant. Since columns are only used above COLUMNS_ORDER, they are
+ * not stored for snapshots of lower order.
+ */
+#define COLUMNS_ALIGNMENT 64
+
+/*
+ * The order above which batches of points are computed by columns. At lower
+ * orders, the kernels looping over n first are as fast.
+ */
+#define COLUMNS_ORDER 32
+
+/* The stride between the arrays of the columns, in number of doubles. */
+static int columns_stride(int order)
+{
+        const int npq = (order * (order + 3)) / 2;
+        const int k = COLUMNS_ALIGNMENT / sizeof(double);
+        return ((npq + k - 1) / k) * k;
+}
+
+/* Utility function for accessing the columns of a snapshot. */
+static inline const double * get_columns(
+    const struct gull_snapshot * snapshot)
+{
+        const int order = snapshot->order;
+        const uintptr_t alignment = COLUMNS_ALIGNMENT;
+        const uintptr_t address =
+            (uintptr_t)(get_coeff_float(snapshot) + float_size(order));
+        return (const double *)((address + alignment - 1) & ~(alignment - 1));
+}
+
+/*
+ * Convert the spherical harmonic coefficients of a snapshot to columns, and
+ * tabulate the corresponding recursion constants. The four arrays of the
+ * columns are spaced by *stride* doubles.
+ */
+static void columns_fill(const struct gull_snapshot * snapshot,
+    double * columns, size_t stride)
+{
+        const int order = snapshot->order;
+        double * const g = columns;
+        double * const h = g + stride;
+        double * const a = h + stride;
+        double * const b = a + stride;
+        int m, n, k = 0;
+        for (m = 0; m <= order; m++) {
+                for (n = (m > 0) ? m : 1; n <= order; n++, k++) {
+                        const double * const c =
+                            snapshot->coeff + n * (n + 1) - 2 + 2 * m;
+                        g[k] = c[0];
+                        h[k] = c[1];
+                        if (n == m) {
+                                a[k] = (m > 1) ? sqrt(1. - 0.5 / m) : 0.;
+                                b[k] = 0.;
+                        } else {
+                                const double aa = sqrt(n * n - m * m);
+                                a[k] = (2. * n - 1.) / aa;
+                                b[k] = sqrt((n - 1.) * (n - 1.) - m * m) / aa;
+                        }
+                }
+        }
+}
+
+/* Initialise the columns of a snapshot, if stored. */
+static void columns_initialise(struct gull_snapshot * snapshot)
+{
+        const int order = snapshot->order;
+        if (order <= COLUMNS_ORDER) return;
+        /* The snapshot is writable here, thus the cast is safe. */
+        double * const columns = (double *)get_columns(snapshot);
+        columns_fill(snapshot, columns, columns_stride(order));
+}
+
+/*
+ * Tabulate the power spectrum of the spherical harmonic coefficients, i.e.
+ * (n + 1) * sum_m (g_nm^2 + h_nm^2) for n in [1, order].
+ */
+static void spectrum_initialise(int order, const double * coeff, double * w)
+{
+        int n;
+        for (n = 1; n <= order; n++) {
+                const double * const cn = coeff + n * (n + 1) - 2;
+                double s = 0.;
+                int m;
+                for (m = 0; m <= 2 * n + 1; m++) s += cn[m] * cn[m];
+                w[n - 1] = (n + 1) * s;
+        }
+}
+
+/*
+ * Tabulate the recursion constants for the Schmidt semi-normalised associated
+ * Legendre functions, up to the given order.
+ *
+ * The constants are stored by pairs, using the same indexing than the
+ * spherical harmonic coefficients. Sectoral terms (m = n) only use the first
+ * constant of their pair. Terms with n <= 2 are explicitly initialised by the
+ * kernel, thus their constants are not used.
+ */
+static void recursion_initialise(int order, double * table)
+{
+        const int npq = (order * (order + 3)) / 2;
+        int k, n = 0, m = 1;
+        for (k = 0; k < npq; k++, m++, table += 2) {
+                if (m > n) {
+                        m = 0;
+                        n++;
+                }
+                if (k < 4) {
+                        table[0] = table[1] = 0.;
+                } else if (m == n) {
+                        table[0] = sqrt(1. - 0.5 / m);
+                        table[1] = 0.;
+                } else {
+                        const double aa = sqrt(n * n - m * m);
+                        table[0] = (2. * n - 1.) / aa;
+                        table[1] = sqrt((n - 1.) * (n - 1.) - m * m) / aa;
+                }
+        }
+}
+
+/* The size of a snapshot, in bytes, given its order. */
+static size_t snapshot_size(int order)
+{
+        const size_t n = (size_t)order * (order + 3);
+        const size_t columns = (order > COLUMNS_ORDER) ?
+            4 * (size_t)columns_stride(order) * sizeof(double) +
+                COLUMNS_ALIGNMENT :
+            0;
+        return sizeof(struct gull_snapshot) +
+            (3 * n + order) * sizeof(double) +
+            float_size(order) * sizeof(float) + columns;
+}
+
+/* Utilities for binary data files and models, see below. */
+static int file_is_binary(FILE * fid);
+static enum gull_return model_load(struct gull_model ** model,
+    const char * path, struct error_context * error_);
+static enum gull_return model_snapshot(struct gull_model * model, double date,
+    struct gull_snapshot ** snapshot, struct error_context * error_);
+
+/* Header of a data set in a COF file. */
+struct cof_header {
+        /* The reference date, as a decimal year. */
+        double epoch;
+        /* The order of the main field coefficients. */
+        int nmax1;
+        /* The order of the secular variation coefficients. */
+        int nmax2;
+        /* The validity period, as decimal years. */
+        double yrmin, yrmax;
+        /* The validity range of altitudes, in km. */
+        double altmin, altmax;
+};
+
+/* Parse the header of a COF data set. Return 1 on success, 0 otherwise. */
+static int cof_parse_header(const char * buffer, struct cof_header * header)
+{
+        const int nread = sscanf(buffer, "%*s %lf %d %d %*d %lf %lf %lf %lf",
+            &header->epoch, &header->nmax1, &header->nmax2, &header->yrmin,
+            &header->yrmax, &header->altmin, &header->altmax);
+        return (nread == 7);
+}
+
+/*
+ * Parse a line of coefficients of a COF data set, i.e. n, m, g1, h1, g2, h2.
+ * This is equivalent to sscanf, but significantly faster.
+ */
+static int cof_parse_line(
+    const char * buffer, int * n, int * m, double values[4])
+{
+        char * end;
+        long l = strtol(buffer, &end, 10);
+        if (end == buffer) return 0;
+        *n = (int)l;
+        buffer = end;
+        l = strtol(buffer, &end, 10);
+        if (end == buffer) return 0;
+        *m = (int)l;
+        buffer = end;
+
+        int i;
+        for (i = 0; i < 4; i++, buffer = end) {
+                values[i] = strtod(buffer, &end);
+                if (end == buffer) return 0;
+        }
+        return 1;
+}
+
+/* Load a snapshot from a data file, for a given decimal year. */
+static enum gull_return snapshot_load(struct gull_snapshot ** snapshot,
+    const char * path, double date, struct error_context * error_)
+{
+        *snapshot = NULL;
 
 #define LINE_WIDTH 81
         /* Open the data file. */
         FILE * fid;
         if ((fid = fopen(path, "r")) == NULL) {
-                return GULL_ERROR_FORMAT(
+                return GULL_ERROR_VREGISTER(
                     GULL_RETURN_PATH_ERROR, "could not open file `%s`", path);
         }
 
-        /* Locate the relevant data set(s). */
+        if (file_is_binary(fid)) {
+                /* Binary files are loaded as a model, which is cheap. */
+                fclose(fid);
+                struct gull_model * model;
+                if (model_load(&model, path, error_) == GULL_RETURN_SUCCESS) {
+                        model_snapshot(model, date, snapshot, error_);
+                        gull_model_destroy(&model);
+                }
+                return error_->code;
+        }
+
+        /*
+         * Locate the relevant data set(s). Since lines have a fixed width,
+         * the coefficients of irrelevant data sets are skipped with a seek,
+         * given the number of lines from their header. If the seek does not
+         * land on the next header, e.g. because of missing lines, the data set
+         * is scanned line by line instead.
+         */
         char buffer[LINE_WIDTH + 14];
         long position[2];
         int line_start[2];
-        int nmax1[2], nmax2[2];
-        double epoch[2], altmin[2], altmax[2];
+        struct cof_header header[2];
         int ndat = 0;
         int line = 0;
-        while (fgets(buffer, LINE_WIDTH + 12, fid)) {
+        long skip_position = -1;
+        int skip_line = 0;
+        for (;;) {
+                const int eof = (fgets(buffer, LINE_WIDTH + 12, fid) == NULL);
+                if (eof && (skip_position < 0)) break;
                 line++;
+                /*
+                 * Coefficient lines might start with blanks as well, e.g.
+                 * with 4 wide degree and order columns. Thus, a header must
+                 * also parse as such.
+                 */
+                const int is_header = !eof &&
+                    (strlen(buffer) == LINE_WIDTH) &&
+                    (strncmp(buffer, "   ", 3) == 0) &&
+                    cof_parse_header(buffer, header + ndat);
+                if ((skip_position >= 0) && !is_header) {
+                        /* The seek failed. Let's scan the data set. */
+                        if (fseek(fid, skip_position, SEEK_SET) != 0)
+                                goto exit_on_syntax_error;
+                        line = skip_line;
+                        skip_position = -1;
+                        continue;
+                }
+                skip_position = -1;
                 if (strlen(buffer) != LINE_WIDTH) goto exit_on_syntax_error;
+                STATS_ADD(bytes_parsed, LINE_WIDTH);
 
-                if (strncmp(buffer, "   ", 3) == 0) {
+                if (is_header) {
                         /* This is a new data set. Let's parse and check the
                          * data set header.
                          */
-                        double yrmin, yrmax;
-                        int nread =
-                            sscanf(buffer, "%*s %lf %d %d %*d %lf %lf %lf %lf",
-                                epoch + ndat, nmax1 + ndat, nmax2 + ndat,
-                                &yrmin, &yrmax, altmin + ndat, altmax + ndat);
-                        if (nread != 7) goto exit_on_syntax_error;
-                        if ((ndat == 0) && ((date < yrmin) || (date > yrmax)))
+                        struct cof_header * h = header + ndat;
+                        if ((h->nmax1 > ORDER_MAX) || (h->nmax2 > ORDER_MAX))
+                                goto exit_on_syntax_error;
+                        if ((ndat == 0) &&
+                            ((date < h->yrmin) || (date > h->yrmax))) {
+                                /* Skip the coefficients of this data set. */
+                                const int nmax = (h->nmax1 > h->nmax2) ?
+                                    h->nmax1 :
+                                    h->nmax2;
+                                const long n_lines = (nmax > 0) ?
+                                    (nmax * (nmax + 3L)) / 2 :
+                                    0;
+                                skip_position = ftell(fid);
+                                skip_line = line;
+                                if ((n_lines == 0) || (skip_position < 0) ||
+                                    (fseek(fid, n_lines * LINE_WIDTH,
+                                         SEEK_CUR) != 0)) {
+                                        skip_position = -1;
+                                } else {
+                                        line += n_lines;
+                                }
                                 continue;
+                        }
 
                         /* This is a valid data set. Let's backup its
                          * position.
@@ -228,12 +757,12 @@ enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
                         position[ndat] = ftell(fid);
                         line_start[ndat] = line;
                         ndat++;
-                        if ((ndat == 2) || (nmax2[0] > 0)) break;
+                        if ((ndat == 2) || (header[0].nmax2 > 0)) break;
                 }
         }
-        if ((ndat == 0) || ((ndat == 1) && (nmax2[0] <= 0))) {
+        if ((ndat == 0) || ((ndat == 1) && (header[0].nmax2 <= 0))) {
                 fclose(fid);
-                return GULL_ERROR_FORMAT(
+                return GULL_ERROR_VREGISTER(
                     GULL_RETURN_MISSING_DATA, "missing data in file `%s`",
                     path);
         }
@@ -241,11 +770,12 @@ enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
         /* Allocate the new and temporary memory. */
         int order;
         if (ndat == 1)
-                order = (nmax1[0] > nmax2[0]) ? nmax1[0] : nmax2[0];
+                order = (header[0].nmax1 > header[0].nmax2) ? header[0].nmax1 :
+                                                              header[0].nmax2;
         else
-                order = (nmax1[0] > nmax1[1]) ? nmax1[0] : nmax1[1];
-        int size = sizeof(struct gull_snapshot) +
-            2 * order * (order + 3) * sizeof(double);
+                order = (header[0].nmax1 > header[1].nmax1) ? header[0].nmax1 :
+                                                              header[1].nmax1;
+        const size_t size = snapshot_size(order);
         *snapshot = malloc(size);
         if (*snapshot == NULL) {
                 GULL_ERROR_REGISTER(
@@ -266,7 +796,7 @@ enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
 
                 const int nc = (ndat == 1) ?
                     (order * (order + 3)) / 2 :
-                    (nmax1[idat] * (nmax1[idat] + 3)) / 2;
+                    (header[idat].nmax1 * (header[idat].nmax1 + 3)) / 2;
                 int ic;
                 for (ic = 0; ic < nc; ic++) {
                         /* Read a new line. */
@@ -275,14 +805,16 @@ enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
                                 goto exit_on_syntax_error;
                         if (strlen(buffer) != LINE_WIDTH)
                                 goto exit_on_syntax_error;
+                        STATS_ADD(bytes_parsed, LINE_WIDTH);
 
                         /* Parse the line. */
                         int i, j;
-                        double g1, h1, g2, h2;
-                        int nread = sscanf(buffer, "%d %d %lf %lf %lf %lf", &i,
-                            &j, &g1, &h1, &g2, &h2);
-                        if ((nread != 6) || (j > i) || (i > order))
+                        double values[4];
+                        if (!cof_parse_line(buffer, &i, &j, values) ||
+                            (i < 1) || (j < 0) || (j > i) || (i > order))
                                 goto exit_on_syntax_error;
+                        const double g1 = values[0], h1 = values[1];
+                        const double g2 = values[2], h2 = values[3];
                         double * p = get_coeff(*snapshot, i, j);
                         if (ndat == 1) {
                                 if ((p[0] != 0.) || (p[1] != 0.) ||
@@ -314,42 +846,57 @@ enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
         /* Interpolate or extrapolate for the required date. */
         if (ndat == 1) {
                 /* Extrapolate. */
-                const double h = date - epoch[0];
+                const double h = date - header[0].epoch;
                 const int nc = (order * (order + 3)) / 2;
                 int ic;
-                double *c0, *c1;
-                for (ic = 0, c0 = c1 = (*snapshot)->coeff; ic < nc;
-                     ic++, c0 += 4, c1 += 2) {
+                double *c0, *c1, *s1;
+                for (ic = 0, c0 = c1 = (*snapshot)->coeff,
+                    s1 = get_slope(*snapshot);
+                     ic < nc; ic++, c0 += 4, c1 += 2, s1 += 2) {
+                        s1[0] = c0[2];
+                        s1[1] = c0[3];
                         c1[0] = c0[0] + c0[2] * h;
                         c1[1] = c0[1] + c0[3] * h;
                 }
 
                 /* Set the altitude range. */
-                (*snapshot)->altmin = altmin[0];
-                (*snapshot)->altmax = altmax[0];
+                (*snapshot)->altmin = header[0].altmin;
+                (*snapshot)->altmax = header[0].altmax;
         } else {
                 /* Interpolate. */
-                const double h = (date - epoch[0]) / (epoch[1] - epoch[0]);
+                const double h = (date - header[0].epoch) /
+                    (header[1].epoch - header[0].epoch);
+                const double dh = 1. / (header[1].epoch - header[0].epoch);
                 const int nc = (order * (order + 3)) / 2;
                 int ic;
-                double *c0, *c1;
-                for (ic = 0, c0 = c1 = (*snapshot)->coeff; ic < nc;
-                     ic++, c0 += 4, c1 += 2) {
+                double *c0, *c1, *s1;
+                for (ic = 0, c0 = c1 = (*snapshot)->coeff,
+                    s1 = get_slope(*snapshot);
+                     ic < nc; ic++, c0 += 4, c1 += 2, s1 += 2) {
+                        s1[0] = (c0[2] - c0[0]) * dh;
+                        s1[1] = (c0[3] - c0[1]) * dh;
                         c1[0] = c0[0] * (1. - h) + c0[2] * h;
                         c1[1] = c0[1] * (1. - h) + c0[3] * h;
                 }
 
                 /* Set the altitude range. */
-                (*snapshot)->altmin =
-                    (altmin[0] > altmin[1]) ? altmin[0] : altmin[1];
-                (*snapshot)->altmax =
-                    (altmax[0] < altmax[1]) ? altmax[0] : altmax[1];
+                (*snapshot)->altmin = (header[0].altmin > header[1].altmin) ?
+                    header[0].altmin :
+                    header[1].altmin;
+                (*snapshot)->altmax = (header[0].altmax < header[1].altmax) ?
+                    header[0].altmax :
+                    header[1].altmax;
         }
 
-        /* Free the extra memory and return. */
-        size =
-            sizeof(struct gull_snapshot) + order * (order + 3) * sizeof(double);
-        *snapshot = realloc(*snapshot, size);
+        /*
+         * Tabulate the recursion constants, using the extra memory left over
+         * by the secular variation terms.
+         */
+        recursion_initialise(order, get_recursion(*snapshot));
+        spectrum_initialise(order, (*snapshot)->coeff, get_spectrum(*snapshot));
+        float_initialise(*snapshot);
+        columns_initialise(*snapshot);
+        STATS_ADD(snapshot_creations, 1);
 
         return GULL_RETURN_SUCCESS;
 
@@ -360,173 +907,3458 @@ exit_on_syntax_error:
 exit_on_runtime_error:
         if (fid != NULL) fclose(fid);
         gull_snapshot_destroy(snapshot);
-        return GULL_ERROR_RAISE();
+        return error_->code;
 
 #undef MAX_NAME_SIZE
 #undef SEGMENT_SIZE
 #undef LINE_WIDTH
 }
 
-void gull_snapshot_destroy(struct gull_snapshot ** snapshot)
+enum gull_return gull_snapshot_create(struct gull_snapshot ** snapshot,
+    const char * path, int day, int month, int year)
 {
-        if ((snapshot == NULL) || (*snapshot == NULL)) return;
-        free(*snapshot);
+        GULL_ERROR_INITIALISE(gull_snapshot_create);
+        STATS_START();
         *snapshot = NULL;
+
+        /* Get the decimal year, and load the snapshot. */
+        double date;
+        if (date_decimal(day, month, year, &date, error_) ==
+            GULL_RETURN_SUCCESS)
+                snapshot_load(snapshot, path, date, error_);
+        STATS_STOP(create_time);
+
+        return GULL_ERROR_RAISE();
 }
 
 /*
- * Compute the geomagnetic field components.
- *
- * This is an adaptation of geomag70/shval3 routine which is based on the
- * subroutine  'igrf' by D. R. Barraclough and S. R. C. Malin, report no. 71/1,
- * institute of geological sciences, U.K.
+ * Cache of shared snapshots, as a linked list of entries. The cache is guarded
+ * by a global lock, when POSIX threads are available.
  */
-enum gull_return gull_snapshot_field(struct gull_snapshot * snapshot,
-    double latitude, double longitude, double altitude, double magnet[3],
-    double ** workspace_)
-{
-        GULL_ERROR_INITIALISE(gull_snapshot_field);
+struct snapshot_share {
+        /* The next entry in the cache. */
+        struct snapshot_share * next;
+        /* The shared snapshot. */
+        struct gull_snapshot * snapshot;
+        /* The number of references to the snapshot. */
+        int references;
+        /* The decimal year of the snapshot. */
+        double date;
+        /* The path to the data file. */
+        char path[];
+};
 
-        const double earths_radius = 6371.2;
-        const double a2 = 40680631.59; /* WGS84. */
-        const double b2 = 40408299.98; /* WGS84. */
-        memset(magnet, 0x0, 3 * sizeof(double));
+static struct snapshot_share * _shares = NULL;
 
-        /* Check the altitude. */
-        altitude *= 1E-03; /* m -> km. */
-        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
-                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
-                    "invalid altitude value: %.5lE", altitude);
-        }
+#ifdef GULL_USE_PTHREAD
+static pthread_mutex_t _shares_lock = PTHREAD_MUTEX_INITIALIZER;
+#define SHARES_LOCK() pthread_mutex_lock(&_shares_lock)
+#define SHARES_UNLOCK() pthread_mutex_unlock(&_shares_lock)
+#else
+#define SHARES_LOCK()
+#define SHARES_UNLOCK()
+#endif
 
-        /* Configure the temporary work memory. */
-        double * workspace = realloc((workspace_ == NULL) ? NULL : *workspace_,
-            snapshot->order * (snapshot->order + 5) * sizeof(*workspace));
-        if (workspace == NULL) {
-                GULL_ERROR_MESSAGE(
-                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
-        }
-        if (workspace_ != NULL) *workspace_ = workspace;
+enum gull_return gull_snapshot_create_shared(struct gull_snapshot ** snapshot,
+    const char * path, int day, int month, int year, int resolution)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_create_shared);
+        *snapshot = NULL;
 
-        /*
-         * Compute the sine and cosine of the latitude, with protection against
-         * poles.
-         */
-        double slat = sin(latitude * M_PI / 180.);
-        double aa;
-        if ((90.0 - latitude) < 0.001) {
-                aa = 89.999; /*  300 ft. from North pole  */
-        } else {
-                if ((90.0 + latitude) < 0.001)
-                        aa = -89.999; /*  300 ft. from South pole  */
-                else
-                        aa = latitude;
+        /* Get the decimal year, quantised to the resolution. */
+        double date;
+        if (date_decimal(day, month, year, &date, error_) !=
+            GULL_RETURN_SUCCESS)
+                return GULL_ERROR_RAISE();
+        if (resolution > 1) {
+                const int leap_year = (((year % 4) == 0) &&
+                    (((year % 100) != 0) || ((year % 400) == 0)));
+                const int n_days = 365 + leap_year;
+                const int day_in_year =
+                    (int)floor((date - year) * n_days + 0.5);
+                const int quantised =
+                    ((day_in_year - 1) / resolution) * resolution + 1;
+                date = year + quantised / (double)n_days;
         }
-        double clat = cos(aa * M_PI / 180.);
-
-        longitude *= M_PI / 180.;
-        double * const sl = workspace;
-        double * const cl = sl + snapshot->order;
-        sl[0] = sin(longitude);
-        cl[0] = cos(longitude);
 
-        /* Convert to geocentric. */
-        aa = a2 * clat * clat;
-        double bb = b2 * slat * slat;
-        double cc = aa + bb;
-        const double dd = sqrt(cc);
-        const double r =
-            sqrt(altitude * (altitude + 2. * dd) + (a2 * aa + b2 * bb) / cc);
-        const double ratio = earths_radius / r;
-        const double cd = (altitude + dd) / r;
-        const double sd = (a2 - b2) * slat * clat / (dd * r);
-        aa = slat;
-        slat = slat * cd - clat * sd;
-        clat = clat * cd + aa * sd;
+        SHARES_LOCK();
 
-        /* Compute the magnetic field components. */
-        const int npq = (snapshot->order * (snapshot->order + 3)) / 2;
-        double * const p = cl + snapshot->order;
-        double * const q = p + npq;
-        aa = sqrt(3.);
-        p[0] = 2. * slat;
-        p[1] = 2. * clat;
-        p[2] = 4.5 * slat * slat - 1.5;
-        p[3] = 3. * aa * clat * slat;
-        q[0] = -clat;
-        q[1] = slat;
-        q[2] = -3.0 * clat * slat;
-        q[3] = aa * (slat * slat - clat * clat);
+        /* Look for an already loaded snapshot. */
+        struct snapshot_share * share;
+        for (share = _shares; share != NULL; share = share->next) {
+                if ((share->date == date) && (strcmp(share->path, path) == 0))
+                        break;
+        }
 
-        double x = 0., y = 0., z = 0.;
-        double rr = 0.;
-        int k, n = 0, m = 1;
-        const double * coeff;
-        for (k = 0, coeff = snapshot->coeff; k < npq; k++, coeff += 2) {
-                if (m > n) {
-                        m = 0;
-                        n++;
-                        rr = pow(ratio, n + 2);
-                }
-                if (k >= 4) {
-                        if (m == n) {
-                                aa = sqrt(1. - 0.5 / m);
-                                const int j = k - n - 1;
-                                p[k] = (1. + 1. / m) * aa * clat * p[j];
-                                q[k] = aa * (clat * q[j] + slat / m * p[j]);
-                                sl[m - 1] =
-                                    sl[m - 2] * cl[0] + cl[m - 2] * sl[0];
-                                cl[m - 1] =
-                                    cl[m - 2] * cl[0] - sl[m - 2] * sl[0];
-                        } else {
-                                aa = sqrt(n * n - m * m);
-                                bb = sqrt((n - 1.) * (n - 1.) - m * m) / aa;
-                                cc = (2. * n - 1.) / aa;
-                                const int ii = k - n;
-                                const int j = k - 2 * n + 1;
-                                p[k] = (n + 1.) *
-                                    (cc * slat / n * p[ii] -
-                                        bb / (n - 1.) * p[j]);
-                                q[k] = cc * (slat * q[ii] - clat / n * p[ii]) -
-                                    bb * q[j];
-                        }
+        if (share == NULL) {
+                /*
+                 * Load a new snapshot. Note that the lock is kept meanwhile,
+                 * such that concurrent requests do not load it twice.
+                 */
+                const size_t size = strlen(path) + 1;
+                share = malloc(sizeof(*share) + size);
+                if (share == NULL) {
+                        SHARES_UNLOCK();
+                        return GULL_ERROR_MESSAGE(GULL_RETURN_MEMORY_ERROR,
+                            "could not allocate memory");
                 }
-                aa = rr * coeff[0];
-                if (m == 0) {
-                        x += aa * q[k];
-                        z -= aa * p[k];
-                } else {
-                        bb = rr * coeff[1];
-                        cc = aa * cl[m - 1] + bb * sl[m - 1];
-                        x += cc * q[k];
-                        z -= cc * p[k];
-                        if (clat > 0) {
-                                y += (aa * sl[m - 1] - bb * cl[m - 1]) * m *
-                                    p[k] / ((n + 1.) * clat);
-                        } else {
-                                y += (aa * sl[m - 1] - bb * cl[m - 1]) * q[k] *
-                                    slat;
-                        }
+                STATS_START();
+                snapshot_load(&share->snapshot, path, date, error_);
+                STATS_STOP(create_time);
+                if (error_->code != GULL_RETURN_SUCCESS) {
+                        SHARES_UNLOCK();
+                        free(share);
+                        return GULL_ERROR_RAISE();
                 }
-                m++;
+                memcpy(share->path, path, size);
+                share->date = date;
+                share->references = 0;
+                share->snapshot->share = share;
+                share->next = _shares;
+                _shares = share;
         }
 
-        /* Free the temporary memory, if not claimed. */
-        if (workspace_ == NULL) free(workspace);
+        share->references++;
+        *snapshot = share->snapshot;
 
-        /* Fill and return. */
-        magnet[0] = y * 1E-09;                  /* East.   */
-        magnet[1] = (x * cd + z * sd) * 1E-09;  /* North.  */
-        magnet[2] = -(z * cd - x * sd) * 1E-09; /* Upward. */
+        SHARES_UNLOCK();
 
         return GULL_RETURN_SUCCESS;
 }
 
-/* Information on a geomagnetic snapshot. */
-void gull_snapshot_info(struct gull_snapshot * snapshot, int * order,
+/* Release a reference to a shared snapshot. */
+static void snapshot_release(struct snapshot_share * share)
+{
+        SHARES_LOCK();
+
+        share->references--;
+        if (share->references > 0) {
+                SHARES_UNLOCK();
+                return;
+        }
+
+        /* Remove the last reference, and free the entry. */
+        struct snapshot_share ** link;
+        for (link = &_shares; *link != share; link = &(*link)->next)
+                ;
+        *link = share->next;
+
+        SHARES_UNLOCK();
+
+        free(share->snapshot);
+        free(share);
+}
+
+void gull_snapshot_destroy(struct gull_snapshot ** snapshot)
+{
+        if ((snapshot == NULL) || (*snapshot == NULL)) return;
+        if ((*snapshot)->share != NULL)
+                snapshot_release((*snapshot)->share);
+        else
+                free(*snapshot);
+        *snapshot = NULL;
+}
+
+/* The reference radius of the Earth for spherical harmonics, in km. */
+#define EARTHS_RADIUS 6371.2
+
+/* The squared semi-axes of the WGS84 ellipsoid, in km^2. */
+#define WGS84_A2 40680631.59
+#define WGS84_B2 40408299.98
+
+/* Geocentric coordinates of an observation point, as used by the kernel. */
+struct location {
+        /* The sine and cosine of the geocentric latitude. */
+        double slat, clat;
+        /* The sine and cosine of the longitude. */
+        double slon, clon;
+        /* The ratio of the Earth's reference radius to the geocentric one. */
+        double ratio;
+        /* The sine and cosine of the geocentric to geodetic rotation. */
+        double sd, cd;
+};
+
+/* Geocentric coordinates of an observation point, in single precision. */
+struct location_float {
+        float slat, clat;
+        float slon, clon;
+        float ratio;
+        float sd, cd;
+};
+
+/*
+ * The number of points evaluated simultaneously by the batch kernel. The
+ * computations are independent across points, i.e. lanes, thus they can be
+ * vectorised, e.g. as a single AVX-512 register, as two AVX2 ones or as four
+ * SSE2 or NEON ones.
+ */
+#define LANES 8
+
+#if defined(__GNUC__) && !defined(GULL_NO_SIMD)
+/* Vectorise the batch kernel using GNU C vector extensions. */
+#define GULL_USE_SIMD
+
+/* Geocentric coordinates of a group of observation points, per lane. */
+struct location_lanes {
+        double slat[LANES], clat[LANES];
+        double slon[LANES], clon[LANES];
+        double ratio[LANES];
+        double sd[LANES], cd[LANES];
+};
+
+/* Copy the coordinates of an observation point to lane *l*. */
+static inline void location_lanes_set(
+    struct location_lanes * lanes, int l, const struct location * location)
+{
+        lanes->slat[l] = location->slat;
+        lanes->clat[l] = location->clat;
+        lanes->slon[l] = location->slon;
+        lanes->clon[l] = location->clon;
+        lanes->ratio[l] = location->ratio;
+        lanes->sd[l] = location->sd;
+        lanes->cd[l] = location->cd;
+}
+
+/*
+ * The number of points evaluated simultaneously by the single precision batch
+ * kernel. Twice as many floats as doubles fit in a vector.
+ */
+#define LANES_FLOAT (2 * LANES)
+
+/* Single precision coordinates of a group of observation points, per lane. */
+struct location_lanes_float {
+        float slat[LANES_FLOAT], clat[LANES_FLOAT];
+        float slon[LANES_FLOAT], clon[LANES_FLOAT];
+        float ratio[LANES_FLOAT];
+        float sd[LANES_FLOAT], cd[LANES_FLOAT];
+};
+
+/* Copy the single precision coordinates of an observation point to lane *l*. */
+static inline void location_lanes_float_set(struct location_lanes_float * lanes,
+    int l, const struct location_float * location)
+{
+        lanes->slat[l] = location->slat;
+        lanes->clat[l] = location->clat;
+        lanes->slon[l] = location->slon;
+        lanes->clon[l] = location->clon;
+        lanes->ratio[l] = location->ratio;
+        lanes->sd[l] = location->sd;
+        lanes->cd[l] = location->cd;
+}
+#endif
+
+/*
+ * Convert geodetic coordinates to geocentric ones, with protection against
+ * poles. The altitude must be given in km.
+ */
+static void location_geodetic(double latitude, double longitude,
+    double altitude, struct location * location)
+{
+        const double a2 = WGS84_A2;
+        const double b2 = WGS84_B2;
+
+        /*
+         * Compute the sine and cosine of the latitude, with protection against
+         * poles.
+         */
+        double slat = sin(latitude * M_PI / 180.);
+        double aa;
+        if ((90.0 - latitude) < 0.001) {
+                aa = 89.999; /*  300 ft. from North pole  */
+        } else {
+                if ((90.0 + latitude) < 0.001)
+                        aa = -89.999; /*  300 ft. from South pole  */
+                else
+                        aa = latitude;
+        }
+        double clat = cos(aa * M_PI / 180.);
+
+        longitude *= M_PI / 180.;
+        location->slon = sin(longitude);
+        location->clon = cos(longitude);
+
+        /* Convert to geocentric. */
+        aa = a2 * clat * clat;
+        const double bb = b2 * slat * slat;
+        const double cc = aa + bb;
+        const double dd = sqrt(cc);
+        const double r =
+            sqrt(altitude * (altitude + 2. * dd) + (a2 * aa + b2 * bb) / cc);
+        location->ratio = EARTHS_RADIUS / r;
+        location->cd = (altitude + dd) / r;
+        location->sd = (a2 - b2) * slat * clat / (dd * r);
+        location->slat = slat * location->cd - clat * location->sd;
+        location->clat = clat * location->cd + slat * location->sd;
+}
+
+/*
+ * Convert geodetic coordinates to geocentric ones, in single precision. This
+ * is the counterpart of `location_geodetic`, with the same protection against
+ * poles.
+ */
+static void location_geodetic_float(float latitude, float longitude,
+    float altitude, struct location_float * location)
+{
+        const float a2 = WGS84_A2;
+        const float b2 = WGS84_B2;
+        const float deg = M_PI / 180.;
+
+        const float slat = sinf(latitude * deg);
+        float aa;
+        if ((90.f - latitude) < 0.001f) {
+                aa = 89.999f;
+        } else {
+                if ((90.f + latitude) < 0.001f)
+                        aa = -89.999f;
+                else
+                        aa = latitude;
+        }
+        const float clat = cosf(aa * deg);
+
+        longitude *= deg;
+        location->slon = sinf(longitude);
+        location->clon = cosf(longitude);
+
+        aa = a2 * clat * clat;
+        const float bb = b2 * slat * slat;
+        const float cc = aa + bb;
+        const float dd = sqrtf(cc);
+        const float r =
+            sqrtf(altitude * (altitude + 2.f * dd) + (a2 * aa + b2 * bb) / cc);
+        location->ratio = (float)EARTHS_RADIUS / r;
+        location->cd = (altitude + dd) / r;
+        location->sd = (a2 - b2) * slat * clat / (dd * r);
+        location->slat = slat * location->cd - clat * location->sd;
+        location->clat = clat * location->cd + slat * location->sd;
+}
+
+/*
+ * Convert ECEF coordinates to geocentric ones. The position must be given in
+ * km. The geodetic altitude is approximated by the distance to the ellipsoid
+ * along the radius, which is returned.
+ */
+static double location_ecef(
+    const double position[3], struct location * location)
+{
+        const double x = position[0], y = position[1], z = position[2];
+        const double rho2 = x * x + y * y;
+        const double r2 = rho2 + z * z;
+        const double rho = sqrt(rho2);
+        const double r = sqrt(r2);
+
+        if (rho > 0.) {
+                location->slon = y / rho;
+                location->clon = x / rho;
+        } else {
+                location->slon = 0.;
+                location->clon = 1.;
+        }
+        location->slat = z / r;
+        location->clat = rho / r;
+        location->ratio = EARTHS_RADIUS / r;
+
+        /* There is no rotation to geodetic coordinates. */
+        location->sd = 0.;
+        location->cd = 1.;
+
+        const double a2 = WGS84_A2;
+        const double b2 = WGS84_B2;
+        const double re = sqrt(a2 * b2 * r2 / (b2 * rho2 + a2 * z * z));
+        return r - re;
+}
+
+/*
+ * Layout of the temporary workspace.
+ *
+ * The workspace starts with a header indicating its capacity, and identifying
+ * the radial factors, i.e. the powers of the radius ratio, cached by the last
+ * evaluation. It is followed by the radial factors, the harmonics of the
+ * longitude and the associated Legendre functions and their derivatives.
+ */
+enum {
+        /* The capacity of the workspace, in number of doubles. */
+        WORKSPACE_CAPACITY = 0,
+        /* The radius ratio of the cached radial factors. */
+        WORKSPACE_RATIO,
+        /* The order of the cached radial factors. */
+        WORKSPACE_ORDER,
+        /* The size of the header. */
+        WORKSPACE_HEADER
+};
+
+/* The size of the temporary workspace, in number of doubles. */
+static size_t workspace_size(int order)
+{
+        return WORKSPACE_HEADER + (size_t)order * (order + 6);
+}
+
+/*
+ * The size of the temporary workspace for batch evaluations, in number of
+ * doubles. The Legendre functions and the longitude harmonics of a group of
+ * points are appended to the workspace of single points, with padding for
+ * their alignment.
+ */
+static size_t workspace_size_lanes(int order)
+{
+#ifdef GULL_USE_SIMD
+        return workspace_size(order) +
+            LANES * ((size_t)order * (order + 5) + 1);
+#else
+        return workspace_size(order);
+#endif
+}
+
+/*
+ * The size of the temporary workspace for batch evaluations of the field of a
+ * snapshot, in number of doubles. Batches computed by columns only need the
+ * workspace of single points, for the remainder of the points.
+ */
+static size_t workspace_size_batch(int order)
+{
+        return (order > COLUMNS_ORDER) ? workspace_size(order) :
+                                         workspace_size_lanes(order);
+}
+
+#ifdef GULL_USE_SIMD
+/* Get the start of the batch part of the workspace, aligned for vectors. */
+static void * workspace_lanes(double * workspace, int order)
+{
+        const uintptr_t alignment = LANES * sizeof(double);
+        const uintptr_t address =
+            (uintptr_t)(workspace + workspace_size(order));
+        return (void *)((address + alignment - 1) & ~(alignment - 1));
+}
+#endif
+
+/* Initialise the header of a new workspace. */
+static void workspace_initialise(double * workspace, size_t capacity)
+{
+        workspace[WORKSPACE_CAPACITY] = capacity;
+        /* Flag the radial factors as invalid. */
+        workspace[WORKSPACE_RATIO] = 0.;
+        workspace[WORKSPACE_ORDER] = 0.;
+}
+
+/*
+ * Configure the temporary work memory, for *size* doubles. If *workspace* is
+ * not `NULL` it is updated with the new memory address. Note that an already
+ * allocated workspace is reused as is, if it is large enough.
+ */
+static double * workspace_configure(size_t size, double ** workspace)
+{
+        if ((workspace != NULL) && (*workspace != NULL) &&
+            ((*workspace)[WORKSPACE_CAPACITY] >= size))
+                return *workspace;
+
+        const int initialise = (workspace == NULL) || (*workspace == NULL);
+        double * memory = realloc(
+            (workspace == NULL) ? NULL : *workspace, size * sizeof(*memory));
+        if (memory == NULL) return NULL;
+        STATS_ADD(workspace_allocations, 1);
+        if (initialise)
+                workspace_initialise(memory, size);
+        else
+                memory[WORKSPACE_CAPACITY] = size;
+        if (workspace != NULL) *workspace = memory;
+        return memory;
+}
+
+/*
+ * Configure the temporary work memory from a user supplied buffer. `NULL` is
+ * returned if the buffer is too small.
+ */
+static double * workspace_attach(int order, void * buffer, size_t size)
+{
+        const size_t capacity = size / sizeof(double);
+        if ((buffer == NULL) || (capacity < workspace_size(order)))
+                return NULL;
+
+        double * memory = buffer;
+        if (memory[WORKSPACE_CAPACITY] != (double)capacity)
+                workspace_initialise(memory, capacity);
+        return memory;
+}
+
+/*
+ * Get the radial factors, i.e. (ratio)^(n + 2) for n in [1, order], from the
+ * workspace. The factors are computed only if the cached ones do not match the
+ * requested radius ratio and order.
+ */
+static const double * workspace_radial(
+    double * workspace, int order, double ratio)
+{
+        double * const radial = workspace + WORKSPACE_HEADER;
+        if ((workspace[WORKSPACE_RATIO] != ratio) ||
+            (workspace[WORKSPACE_ORDER] != order)) {
+                double rr = ratio * ratio;
+                int n;
+                for (n = 0; n < order; n++) {
+                        rr *= ratio;
+                        radial[n] = rr;
+                }
+                workspace[WORKSPACE_RATIO] = ratio;
+                workspace[WORKSPACE_ORDER] = order;
+        }
+        return radial;
+}
+
+/*
+ * Scaling of the associated Legendre functions, following Holmes and
+ * Featherstone (2002). At high orders, the sectoral terms underflow near the
+ * poles, while the following terms of the same order could still contribute.
+ * Thus, the recursions are seeded with scaled values, and the sums are
+ * unscaled when converting to Tesla. Since the scale is a power of 2, the
+ * results are bit identical unless an underflow would have occurred.
+ */
+#define LEGENDRE_SCALE 0x1p+930
+
+/*
+ * Compute the geomagnetic field components, in ENU.
+ *
+ * This is an adaptation of geomag70/shval3 routine which is based on the
+ * subroutine  'igrf' by D. R. Barraclough and S. R. C. Malin, report no. 71/1,
+ * institute of geological sciences, U.K.
+ *
+ * The spherical harmonic coefficients are given as *coeff*. If *slope* is not
+ * `NULL`, the coefficients are linearly propagated in time, on the fly, i.e.
+ * as coeff + slope * dt.
+ *
+ * If *rate* is not `NULL`, the time derivative of the field is computed as
+ * well, in the same pass, using *slope* as coefficients. In this case *slope*
+ * must not be `NULL`.
+ *
+ * If *gradient* is not `NULL`, the spatial derivatives of the field are
+ * computed as well, from the same Legendre functions and longitude harmonics.
+ * The second derivatives of the Legendre functions are not needed, since their
+ * contribution is obtained from the Legendre differential equation, i.e.
+ *
+ *     P'' = -cot(theta) P' - (n * (n + 1) - m^2 / sin^2(theta)) P.
+ */
+static GULL_INLINE void field_sum(int order, const double * coeff,
+    const double * slope, double dt, const double * table,
+    const struct location * location, double * workspace, double magnet[3],
+    double rate[3], double gradient[9])
+{
+        const double slat = location->slat;
+        const double clat = location->clat;
+        const double * const radial =
+            workspace_radial(workspace, order, location->ratio);
+        double * const sl = workspace + WORKSPACE_HEADER + order;
+        double * const cl = sl + order;
+        sl[0] = location->slon;
+        cl[0] = location->clon;
+
+        /*
+         * Compute the magnetic field components. Note that the Legendre
+         * functions, *p*, and their derivatives, *q*, are not scaled by the
+         * (n + 1) factor of the radial derivative. Instead, the contributions
+         * are summed up per degree, and then scaled.
+         */
+        const int npq = (order * (order + 3)) / 2;
+        double * const p = cl + order;
+        double * const q = p + npq;
+        const double aa = sqrt(3.);
+        const double scale = LEGENDRE_SCALE;
+        p[0] = slat * scale;
+        p[1] = clat * scale;
+        p[2] = (1.5 * slat * slat - 0.5) * scale;
+        p[3] = aa * clat * slat * scale;
+        q[0] = -clat * scale;
+        q[1] = slat * scale;
+        q[2] = -3.0 * clat * slat * scale;
+        q[3] = aa * (slat * slat - clat * clat) * scale;
+
+        /*
+         * The East component involves m * p / clat, which is singular at
+         * poles. There, it is computed from q * slat instead.
+         */
+        const int polar = !(clat > 0);
+        const double yfactor = polar ? slat : 1. / clat;
+
+        /*
+         * Sums of the Hessian of the potential, in spherical coordinates,
+         * weighted by the radial factor of each degree.
+         */
+        double hrr = 0., hrt = 0., hrp = 0., hs0 = 0., hs1 = 0., hu0 = 0.,
+               ht0 = 0., ht1 = 0.;
+
+        double x = 0., y = 0., z = 0.;
+        double xs = 0., ys = 0., zs = 0.;
+        int n;
+        GULL_UNROLL
+        for (n = 1; n <= order; n++) {
+                /* Offset of the (n, 0) terms. */
+                const int k0 = (n * (n + 1)) / 2 - 1;
+                double * const pn = p + k0;
+                double * const qn = q + k0;
+                const double * const tn = table + 2 * k0;
+
+                /* Recurse the Legendre functions of degree n >= 3. */
+                int m;
+                if (n >= 3) {
+                        const double * const p1 = pn - n;
+                        const double * const q1 = qn - n;
+                        const double * const p2 = p1 - n + 1;
+                        const double * const q2 = q1 - n + 1;
+                        GULL_UNROLL
+                        for (m = 0; m < n - 1; m++) {
+                                const double * const t = tn + 2 * m;
+                                pn[m] = t[0] * slat * p1[m] - t[1] * p2[m];
+                                qn[m] = t[0] * (slat * q1[m] - clat * p1[m]) -
+                                    t[1] * q2[m];
+                        }
+                        const double * const t = tn + 2 * m;
+                        pn[m] = t[0] * slat * p1[m];
+                        qn[m] = t[0] * (slat * q1[m] - clat * p1[m]);
+                }
+
+                /* Recurse the sectoral terms, and the longitude harmonics. */
+                if (n >= 2) {
+                        const double * const p1 = pn - n;
+                        const double * const q1 = qn - n;
+                        const double t = tn[2 * n];
+                        pn[n] = t * clat * p1[n - 1];
+                        qn[n] = t * (clat * q1[n - 1] + slat * p1[n - 1]);
+                        sl[n - 1] = sl[n - 2] * cl[0] + cl[n - 2] * sl[0];
+                        cl[n - 1] = cl[n - 2] * cl[0] - sl[n - 2] * sl[0];
+                }
+
+                /* Sum up the contributions of degree n. */
+                const double * const cn = coeff + 2 * k0;
+                const double * const sn = (slope == NULL) ? NULL :
+                                                            slope + 2 * k0;
+                double g = cn[0];
+                if (sn != NULL) g += sn[0] * dt;
+                double xn = g * qn[0], yn = 0., zn = g * pn[0];
+                double t0n = 0., t1n = 0., u0n = 0.;
+                double xsn = 0., ysn = 0., zsn = 0.;
+                if (rate != NULL) {
+                        xsn = sn[0] * qn[0];
+                        zsn = sn[0] * pn[0];
+                }
+                GULL_UNROLL
+                for (m = 1; m <= n; m++) {
+                        double h = cn[2 * m + 1];
+                        g = cn[2 * m];
+                        if (sn != NULL) {
+                                g += sn[2 * m] * dt;
+                                h += sn[2 * m + 1] * dt;
+                        }
+                        const double cc = g * cl[m - 1] + h * sl[m - 1];
+                        const double dd = g * sl[m - 1] - h * cl[m - 1];
+                        xn += cc * qn[m];
+                        zn += cc * pn[m];
+                        if (polar)
+                                yn += dd * qn[m];
+                        else
+                                yn += dd * m * pn[m];
+                        if (rate != NULL) {
+                                const double gs = sn[2 * m];
+                                const double hs = sn[2 * m + 1];
+                                const double cs =
+                                    gs * cl[m - 1] + hs * sl[m - 1];
+                                const double ds =
+                                    gs * sl[m - 1] - hs * cl[m - 1];
+                                xsn += cs * qn[m];
+                                zsn += cs * pn[m];
+                                if (polar)
+                                        ysn += ds * qn[m];
+                                else
+                                        ysn += ds * m * pn[m];
+                        }
+                        if (gradient != NULL) {
+                                t0n += dd * m * pn[m];
+                                t1n += dd * m * qn[m];
+                                u0n += cc * m * m * pn[m];
+                        }
+                }
+
+                const double rr = radial[n - 1];
+                x += rr * xn;
+                y += rr * yfactor * yn;
+                z -= (n + 1.) * rr * zn;
+
+                if (rate != NULL) {
+                        xs += rr * xsn;
+                        ys += rr * yfactor * ysn;
+                        zs -= (n + 1.) * rr * zsn;
+                }
+
+                if (gradient != NULL) {
+                        hrr += (n + 1.) * (n + 2.) * rr * zn;
+                        hrt += (n + 2.) * rr * xn;
+                        hrp += (n + 2.) * rr * t0n;
+                        hs0 += (n + 1.) * (n + 1.) * rr * zn;
+                        hs1 += rr * xn;
+                        hu0 += rr * u0n;
+                        ht0 += rr * t0n;
+                        ht1 += rr * t1n;
+                }
+        }
+
+        /* Rotate to geodetic, unscale and fill. */
+        const double cd = location->cd;
+        const double sd = location->sd;
+        const double unit = 1E-09 / LEGENDRE_SCALE;
+        magnet[0] = y * unit;                  /* East.   */
+        magnet[1] = (x * cd + z * sd) * unit;  /* North.  */
+        magnet[2] = -(z * cd - x * sd) * unit; /* Upward. */
+
+        if (rate != NULL) {
+                rate[0] = ys * unit;
+                rate[1] = (xs * cd + zs * sd) * unit;
+                rate[2] = -(zs * cd - xs * sd) * unit;
+        }
+
+        if (gradient != NULL) {
+                /*
+                 * Complete the Hessian of the potential, in spherical
+                 * coordinates (r, theta, phi). The radial factors are per unit
+                 * radius, and the theta-theta term follows from the Legendre
+                 * differential equation. The phi-phi term is set by Laplace's
+                 * equation, i.e. the Hessian is traceless.
+                 */
+                const double w =
+                    location->ratio * 1E-12 / EARTHS_RADIUS / LEGENDRE_SCALE;
+                const double cot = slat / clat;
+                const double h_rr = hrr * w;
+                const double h_rt = -hrt * w;
+                const double h_rp = hrp * w / clat;
+                const double h_tt =
+                    (-cot * hs1 - hs0 + hu0 / (clat * clat)) * w;
+                const double h_tp = (cot * ht0 - ht1) * w / clat;
+                const double h_pp = -(h_rr + h_tt);
+
+                /*
+                 * Get the gradient of the field, i.e. minus the Hessian, along
+                 * the geocentric E, N, U axes. Note that N is along -theta.
+                 */
+                const double gee = -h_pp, gen = h_tp, geu = -h_rp;
+                const double gnn = -h_tt, gnu = h_rt, guu = -h_rr;
+
+                /* Rotate to geodetic and fill, as a symmetric matrix. */
+                gradient[0] = gee;
+                gradient[1] = gradient[3] = cd * gen - sd * geu;
+                gradient[2] = gradient[6] = sd * gen + cd * geu;
+                gradient[4] =
+                    cd * cd * gnn - 2. * cd * sd * gnu + sd * sd * guu;
+                gradient[5] = gradient[7] =
+                    cd * sd * (gnn - guu) + (cd * cd - sd * sd) * gnu;
+                gradient[8] =
+                    sd * sd * gnn + 2. * cd * sd * gnu + cd * cd * guu;
+        }
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot, in ENU.
+ *
+ * The kernel is specialised for the orders of the shipped data sets, i.e. 13
+ * for IGRF13, 12 for WMM2020 and 10 for IGRF data sets prior to 2000. In these
+ * cases the loops can be fully unrolled at compile time.
+ */
+static void field_kernel(const struct gull_snapshot * snapshot,
+    const struct location * location, double * workspace, double magnet[3])
+{
+#define FIELD_SUM(order)                                                       \
+        field_sum(order, snapshot->coeff, NULL, 0., get_recursion(snapshot),   \
+            location, workspace, magnet, NULL, NULL)
+
+        switch (snapshot->order) {
+        case 13: FIELD_SUM(13); break;
+        case 12: FIELD_SUM(12); break;
+        case 10: FIELD_SUM(10); break;
+        default: FIELD_SUM(snapshot->order); break;
+        }
+
+#undef FIELD_SUM
+}
+
+#ifdef GULL_USE_SIMD
+/* Vectors of doubles, and the corresponding comparison masks. */
+typedef double lanes2_t __attribute__((vector_size(2 * sizeof(double))));
+typedef int64_t mask2_t __attribute__((vector_size(2 * sizeof(double))));
+typedef double lanes4_t __attribute__((vector_size(4 * sizeof(double))));
+typedef int64_t mask4_t __attribute__((vector_size(4 * sizeof(double))));
+typedef double lanes8_t __attribute__((vector_size(8 * sizeof(double))));
+typedef int64_t mask8_t __attribute__((vector_size(8 * sizeof(double))));
+
+/* Vectors of floats, and the corresponding comparison masks. */
+typedef float lanes4f_t __attribute__((vector_size(4 * sizeof(float))));
+typedef int32_t mask4f_t __attribute__((vector_size(4 * sizeof(float))));
+typedef float lanes8f_t __attribute__((vector_size(8 * sizeof(float))));
+typedef int32_t mask8f_t __attribute__((vector_size(8 * sizeof(float))));
+typedef float lanes16f_t __attribute__((vector_size(16 * sizeof(float))));
+typedef int32_t mask16f_t __attribute__((vector_size(16 * sizeof(float))));
+
+/* Prototype of batch kernels, as instantiated for a specific ISA. */
+typedef void field_lanes_t(int order, const double * coeff,
+    const double * slope, const double * dt, const double * table,
+    const struct location_lanes * location, double * workspace,
+    double * magnet);
+
+/* Prototype of batch kernels by columns. */
+typedef void field_columns_t(int order, const double * columns, int stride,
+    const struct location_lanes * location, double * magnet);
+
+/* Prototype of single precision batch kernels. */
+typedef void field_lanes_float_t(int order, const float * coeff,
+    const float * slope, const float * dt, const float * table,
+    const struct location_lanes_float * location, double * workspace,
+    float * magnet);
+
+#define LANES_CONCAT_(a, b) a##b
+#define LANES_CONCAT(a, b) LANES_CONCAT_(a, b)
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Dispatch the batch kernel at runtime, according to the CPU capabilities. */
+#define GULL_DISPATCH_X86
+
+#define FIELD_LANES field_lanes_avx512
+#define FIELD_COLUMNS field_columns_avx512
+#define FIELD_LANES_TARGET __attribute__((target("avx512f")))
+#define LANES_REAL double
+#define LANES_SCALE LEGENDRE_SCALE
+#define LANES_GROUP LANES
+#define LANES_LOCATION struct location_lanes
+#define LANES_WIDTH 8
+#define LANES_T lanes8_t
+#define LANES_MASK_T mask8_t
+#include "gull-lanes.inc"
+
+#define FIELD_LANES field_lanes_avx2
+#define FIELD_COLUMNS field_columns_avx2
+#define FIELD_LANES_TARGET __attribute__((target("avx2")))
+#define LANES_REAL double
+#define LANES_SCALE LEGENDRE_SCALE
+#define LANES_GROUP LANES
+#define LANES_LOCATION struct location_lanes
+#define LANES_WIDTH 4
+#define LANES_T lanes4_t
+#define LANES_MASK_T mask4_t
+#include "gull-lanes.inc"
+
+#define FIELD_LANES field_lanes_float_avx512
+#define FIELD_LANES_TARGET __attribute__((target("avx512f")))
+#define LANES_REAL float
+#define LANES_SCALE 1
+#define LANES_GROUP LANES_FLOAT
+#define LANES_LOCATION struct location_lanes_float
+#define LANES_WIDTH 16
+#define LANES_T lanes16f_t
+#define LANES_MASK_T mask16f_t
+#include "gull-lanes.inc"
+
+#define FIELD_LANES field_lanes_float_avx2
+#define FIELD_LANES_TARGET __attribute__((target("avx2")))
+#define LANES_REAL float
+#define LANES_SCALE 1
+#define LANES_GROUP LANES_FLOAT
+#define LANES_LOCATION struct location_lanes_float
+#define LANES_WIDTH 8
+#define LANES_T lanes8f_t
+#define LANES_MASK_T mask8f_t
+#include "gull-lanes.inc"
+#endif
+
+/*
+ * The default batch kernels, for the baseline ISA, e.g. SSE2 on x86_64 or NEON
+ * on AArch64.
+ */
+#define FIELD_LANES field_lanes_default
+#define FIELD_COLUMNS field_columns_default
+#define FIELD_LANES_TARGET
+#define LANES_REAL double
+#define LANES_SCALE LEGENDRE_SCALE
+#define LANES_GROUP LANES
+#define LANES_LOCATION struct location_lanes
+#define LANES_WIDTH 2
+#define LANES_T lanes2_t
+#define LANES_MASK_T mask2_t
+#include "gull-lanes.inc"
+
+#define FIELD_LANES field_lanes_float_default
+#define FIELD_LANES_TARGET
+#define LANES_REAL float
+#define LANES_SCALE 1
+#define LANES_GROUP LANES_FLOAT
+#define LANES_LOCATION struct location_lanes_float
+#define LANES_WIDTH 4
+#define LANES_T lanes4f_t
+#define LANES_MASK_T mask4f_t
+#include "gull-lanes.inc"
+
+#undef LANES_CONCAT
+#undef LANES_CONCAT_
+
+/* Select the batch kernel matching the CPU capabilities. */
+static field_lanes_t * field_lanes(void)
+{
+#ifdef GULL_DISPATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return &field_lanes_avx512;
+        if (__builtin_cpu_supports("avx2")) return &field_lanes_avx2;
+#endif
+        return &field_lanes_default;
+}
+
+/* Select the batch kernel by columns matching the CPU capabilities. */
+static field_columns_t * field_columns_lanes(void)
+{
+#ifdef GULL_DISPATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return &field_columns_avx512;
+        if (__builtin_cpu_supports("avx2")) return &field_columns_avx2;
+#endif
+        return &field_columns_default;
+}
+
+/* Select the single precision batch kernel matching the CPU capabilities. */
+static field_lanes_float_t * field_lanes_float(void)
+{
+#ifdef GULL_DISPATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+                return &field_lanes_float_avx512;
+        if (__builtin_cpu_supports("avx2")) return &field_lanes_float_avx2;
+#endif
+        return &field_lanes_float_default;
+}
+#endif
+
+enum gull_return gull_snapshot_field(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double magnet[3],
+    double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        field_kernel(snapshot, &location, workspace, magnet);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Select the truncation order of a snapshot, at the radius ratio of some
+ * location. The order is the lowest one, up to *order*, for which the RMS of
+ * the dropped terms over the sphere is below *tolerance*, in nT. The RMS is
+ * obtained from the power spectrum, weighted by the radial factors.
+ */
+static int field_truncation(const struct gull_snapshot * snapshot, int order,
+    double tolerance, double ratio, double * workspace)
+{
+        if (tolerance <= 0.) return order;
+
+        const double * const radial =
+            workspace_radial(workspace, snapshot->order, ratio);
+        const double * const spectrum = get_spectrum(snapshot);
+        const double tol2 = tolerance * tolerance;
+        double tail = 0.;
+        int n;
+        for (n = order; n > 1; n--) {
+                const double rr = radial[n - 1];
+                tail += spectrum[n - 1] * rr * rr;
+                if (tail > tol2) break;
+        }
+        return n;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot, up to *order*. The
+ * kernel is specialised for the same orders than `field_kernel`.
+ */
+static void truncated_kernel(const struct gull_snapshot * snapshot, int order,
+    const struct location * location, double * workspace, double magnet[3])
+{
+#define FIELD_SUM(order)                                                       \
+        field_sum(order, snapshot->coeff, NULL, 0., get_recursion(snapshot),   \
+            location, workspace, magnet, NULL, NULL)
+
+        switch (order) {
+        case 13: FIELD_SUM(13); break;
+        case 12: FIELD_SUM(12); break;
+        case 10: FIELD_SUM(10); break;
+        default: FIELD_SUM(order); break;
+        }
+
+#undef FIELD_SUM
+}
+
+enum gull_return gull_snapshot_field_truncated(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, int order,
+    double tolerance, double magnet[3], int * order_used, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_truncated);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+        if (order_used != NULL) *order_used = 0;
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Select the truncation order. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        if ((order <= 0) || (order > snapshot->order)) order = snapshot->order;
+        order = field_truncation(
+            snapshot, order, tolerance * 1E+09, location.ratio, workspace);
+        if (order_used != NULL) *order_used = order;
+
+        /* Compute the magnetic field components. */
+        truncated_kernel(snapshot, order, &location, workspace, magnet);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_snapshot_field_ecef(struct gull_snapshot * snapshot,
+    const double position[3], double magnet[3], double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_ecef);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+
+        /* Convert the position and check the altitude. */
+        const double position_km[3] = { position[0] * 1E-03,
+                position[1] * 1E-03, position[2] * 1E-03 }; /* m -> km. */
+        struct location location;
+        const double altitude = location_ecef(position_km, &location);
+        if (!((altitude >= snapshot->altmin) &&
+                (altitude <= snapshot->altmax))) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components, in geocentric ENU. */
+        double enu[3];
+        field_kernel(snapshot, &location, workspace, enu);
+
+        /* Rotate to ECEF. */
+        const double slat = location.slat, clat = location.clat;
+        const double slon = location.slon, clon = location.clon;
+        const double bh = clat * enu[2] - slat * enu[1];
+        magnet[0] = clon * bh - slon * enu[0];
+        magnet[1] = slon * bh + clon * enu[0];
+        magnet[2] = clat * enu[1] + slat * enu[2];
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot and their time
+ * derivatives, in ENU. Note that this kernel is not specialised, since fully
+ * unrolling the extra sums was found to be slower.
+ */
+static void rate_kernel(const struct gull_snapshot * snapshot,
+    const struct location * location, double * workspace, double magnet[3],
+    double rate[3])
+{
+        field_sum(snapshot->order, snapshot->coeff, get_slope(snapshot), 0.,
+            get_recursion(snapshot), location, workspace, magnet, rate, NULL);
+}
+
+enum gull_return gull_snapshot_field_rate(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double magnet[3],
+    double rate[3], double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_rate);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+        memset(rate, 0x0, 3 * sizeof(double));
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components and their time derivatives. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        rate_kernel(snapshot, &location, workspace, magnet, rate);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot and their spatial
+ * derivatives, in ENU. Note that this kernel is not specialised.
+ */
+static void gradient_kernel(const struct gull_snapshot * snapshot,
+    const struct location * location, double * workspace, double magnet[3],
+    double gradient[9])
+{
+        field_sum(snapshot->order, snapshot->coeff, NULL, 0.,
+            get_recursion(snapshot), location, workspace, magnet, NULL,
+            gradient);
+}
+
+enum gull_return gull_snapshot_field_gradient(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double magnet[3],
+    double gradient[9], double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_gradient);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+        memset(gradient, 0x0, 9 * sizeof(double));
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components and their derivatives. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        gradient_kernel(snapshot, &location, workspace, magnet, gradient);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_snapshot_field_buffer(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, double magnet[3],
+    void * buffer, size_t size)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_buffer);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Map the temporary work memory on the user supplied buffer. */
+        double * workspace = workspace_attach(snapshot->order, buffer, size);
+        if (workspace == NULL) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_MEMORY_ERROR,
+                    "workspace is too small (%lu < %lu)", (unsigned long)size,
+                    (unsigned long)gull_snapshot_workspace_size(snapshot));
+        }
+
+        /* Compute the magnetic field components. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        field_kernel(snapshot, &location, workspace, magnet);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot for a batch of points,
+ * in ENU. The points are computed by groups, and the remaining ones one by
+ * one. The workspace must be configured for batch evaluations. Note that the
+ * altitudes are not checked.
+ */
+static void snapshot_field_batch(const struct gull_snapshot * snapshot, int n,
+    const double * latitude, const double * longitude, const double * altitude,
+    double * magnet, double * workspace)
+{
+        int i = 0;
+#ifdef GULL_USE_SIMD
+        const int order = snapshot->order;
+        field_lanes_t * const kernel = field_lanes();
+        field_columns_t * const columns = field_columns_lanes();
+        for (; i + LANES <= n; i += LANES, magnet += 3 * LANES) {
+                struct location_lanes location;
+                int l;
+                for (l = 0; l < LANES; l++) {
+                        struct location point;
+                        location_geodetic(latitude[i + l], longitude[i + l],
+                            altitude[i + l] * 1E-03, &point);
+                        location_lanes_set(&location, l, &point);
+                }
+                if (order > COLUMNS_ORDER) {
+                        columns(order, get_columns(snapshot),
+                            columns_stride(order), &location, magnet);
+                } else {
+                        kernel(order, snapshot->coeff, NULL, NULL,
+                            get_recursion(snapshot), &location, workspace,
+                            magnet);
+                }
+        }
+#endif
+        for (; i < n; i++, magnet += 3) {
+                struct location location;
+                location_geodetic(
+                    latitude[i], longitude[i], altitude[i] * 1E-03, &location);
+                field_kernel(snapshot, &location, workspace, magnet);
+        }
+}
+
+enum gull_return gull_snapshot_field_v(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, double * magnet, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_v);
+        STATS_START();
+        if (n <= 0) return GULL_RETURN_SUCCESS;
+
+        /* Configure the temporary work memory, once for all points. */
+        double * workspace = workspace_configure(
+            workspace_size_batch(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                memset(magnet, 0x0, 3 * (size_t)n * sizeof(*magnet));
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Check the altitudes. */
+        const double altmin = snapshot->altmin;
+        const double altmax = snapshot->altmax;
+        int i, invalid = -1;
+        for (i = 0; i < n; i++) {
+                const double z = altitude[i] * 1E-03; /* m -> km. */
+                if ((z < altmin) || (z > altmax)) {
+                        invalid = i;
+                        break;
+                }
+        }
+
+        /* Compute the magnetic field components. */
+        snapshot_field_batch(
+            snapshot, n, latitude, longitude, altitude, magnet, workspace);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(n);
+
+        if (invalid >= 0) {
+                STATS_DOMAIN(n - invalid, altitude + invalid, altmin, altmax);
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE [index %d]",
+                    altitude[invalid] * 1E-03, invalid);
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Check the altitudes of a group of up to 8 points, given in m. The validity
+ * flags are returned as a bitmask. The comparisons are branchless, such that
+ * the loop can be vectorised.
+ */
+static inline unsigned int field_check(const struct gull_snapshot * snapshot,
+    int n, const double * altitude)
+{
+        const double altmin = snapshot->altmin;
+        const double altmax = snapshot->altmax;
+        unsigned int bits = 0;
+        int l;
+        for (l = 0; l < n; l++) {
+                const double z = altitude[l] * 1E-03; /* m -> km. */
+                bits |= (unsigned int)((z >= altmin) & (z <= altmax)) << l;
+        }
+        return bits;
+}
+
+enum gull_return gull_snapshot_field_checked(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, enum gull_domain_policy policy, double * magnet,
+    unsigned char * valid, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_checked);
+        STATS_START();
+        if ((unsigned int)policy >= GULL_N_DOMAIN_POLICIES) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid domain policy `%d`", (int)policy);
+        }
+        if (n <= 0) return GULL_RETURN_SUCCESS;
+
+        /* Configure the temporary work memory, once for all points. */
+        double * workspace = workspace_configure(
+            workspace_size_batch(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                memset(magnet, 0x0, 3 * (size_t)n * sizeof(*magnet));
+                if (valid != NULL) memset(valid, 0x0, ((size_t)n + 7) / 8);
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /*
+         * Process the points by chunks. The altitudes of a chunk are checked
+         * first. Chunks without any invalid point, i.e. the common case, are
+         * computed as is, and the policy is only applied to the others.
+         */
+#define CHECKED_CHUNK (32 * LANES)
+        const double zmin = snapshot->altmin * 1E+03; /* km -> m. */
+        const double zmax = snapshot->altmax * 1E+03;
+        int i;
+        for (i = 0; i < n; i += CHECKED_CHUNK) {
+                const int m = (i + CHECKED_CHUNK <= n) ? CHECKED_CHUNK : n - i;
+                unsigned char bits[CHECKED_CHUNK / 8];
+                unsigned int all = 0xFF;
+                int j;
+                for (j = 0; j < m; j += 8) {
+                        const int k = (m - j < 8) ? m - j : 8;
+                        const unsigned int flags =
+                            field_check(snapshot, k, altitude + i + j);
+                        bits[j / 8] = flags;
+                        all &= flags | (0xFF << k);
+                }
+                if (valid != NULL) memcpy(valid + i / 8, bits, (m + 7) / 8);
+                if (all != 0xFF) {
+                        for (j = 0; j < m; j++) {
+                                STATS_ADD(domain_points,
+                                    !(bits[j / 8] & (1U << (j % 8))));
+                        }
+                }
+
+                double * const b = magnet + 3 * (size_t)i;
+                if ((all == 0xFF) || (policy == GULL_DOMAIN_COMPUTE)) {
+                        snapshot_field_batch(snapshot, m, latitude + i,
+                            longitude + i, altitude + i, b, workspace);
+                } else if (policy == GULL_DOMAIN_CLAMP) {
+                        double z[CHECKED_CHUNK];
+                        for (j = 0; j < m; j++) {
+                                const double zj = altitude[i + j];
+                                z[j] = (zj < zmin) ? zmin :
+                                                     ((zj > zmax) ? zmax : zj);
+                        }
+                        snapshot_field_batch(snapshot, m, latitude + i,
+                            longitude + i, z, b, workspace);
+                } else {
+                        snapshot_field_batch(snapshot, m, latitude + i,
+                            longitude + i, altitude + i, b, workspace);
+                        for (j = 0; j < m; j++) {
+                                if (bits[j / 8] & (1U << (j % 8))) continue;
+                                b[3 * j] = b[3 * j + 1] = b[3 * j + 2] = NAN;
+                        }
+                }
+        }
+#undef CHECKED_CHUNK
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(n);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Compute the geomagnetic field components in single precision, in ENU.
+ *
+ * This is a reduced version of `field_sum`, i.e. without time propagation and
+ * derivatives, operating on single precision coefficients and recursion
+ * constants. The radial factors are computed on the fly, and the temporary
+ * data are stored as floats past the cached radial factors of the workspace,
+ * which are thus preserved.
+ */
+static GULL_INLINE void field_sum_float(int order, const float * coeff,
+    const float * table, const struct location_float * location,
+    double * workspace, float magnet[3])
+{
+        const float slat = location->slat;
+        const float clat = location->clat;
+        const float ratio = location->ratio;
+        float * const sl = (float *)(workspace + WORKSPACE_HEADER + order);
+        float * const cl = sl + order;
+        sl[0] = location->slon;
+        cl[0] = location->clon;
+
+        const int npq = (order * (order + 3)) / 2;
+        float * const p = cl + order;
+        float * const q = p + npq;
+        const float aa = sqrt(3.);
+        p[0] = slat;
+        p[1] = clat;
+        p[2] = 1.5f * slat * slat - 0.5f;
+        p[3] = aa * clat * slat;
+        q[0] = -clat;
+        q[1] = slat;
+        q[2] = -3.0f * clat * slat;
+        q[3] = aa * (slat * slat - clat * clat);
+
+        const int polar = !(clat > 0);
+        const float yfactor = polar ? slat : 1.f / clat;
+
+        float x = 0.f, y = 0.f, z = 0.f;
+        float rr = ratio * ratio;
+        int n;
+        GULL_UNROLL
+        for (n = 1; n <= order; n++) {
+                const int k0 = (n * (n + 1)) / 2 - 1;
+                float * const pn = p + k0;
+                float * const qn = q + k0;
+                const float * const tn = table + 2 * k0;
+
+                /* Recurse the Legendre functions of degree n >= 3. */
+                int m;
+                if (n >= 3) {
+                        const float * const p1 = pn - n;
+                        const float * const q1 = qn - n;
+                        const float * const p2 = p1 - n + 1;
+                        const float * const q2 = q1 - n + 1;
+                        GULL_UNROLL
+                        for (m = 0; m < n - 1; m++) {
+                                const float * const t = tn + 2 * m;
+                                pn[m] = t[0] * slat * p1[m] - t[1] * p2[m];
+                                qn[m] = t[0] * (slat * q1[m] - clat * p1[m]) -
+                                    t[1] * q2[m];
+                        }
+                        const float * const t = tn + 2 * m;
+                        pn[m] = t[0] * slat * p1[m];
+                        qn[m] = t[0] * (slat * q1[m] - clat * p1[m]);
+                }
+
+                /* Recurse the sectoral terms, and the longitude harmonics. */
+                if (n >= 2) {
+                        const float * const p1 = pn - n;
+                        const float * const q1 = qn - n;
+                        const float t = tn[2 * n];
+                        pn[n] = t * clat * p1[n - 1];
+                        qn[n] = t * (clat * q1[n - 1] + slat * p1[n - 1]);
+                        sl[n - 1] = sl[n - 2] * cl[0] + cl[n - 2] * sl[0];
+                        cl[n - 1] = cl[n - 2] * cl[0] - sl[n - 2] * sl[0];
+                }
+
+                /* Sum up the contributions of degree n. */
+                const float * const cn = coeff + 2 * k0;
+                float xn = cn[0] * qn[0], yn = 0.f, zn = cn[0] * pn[0];
+                GULL_UNROLL
+                for (m = 1; m <= n; m++) {
+                        const float g = cn[2 * m], h = cn[2 * m + 1];
+                        const float cc = g * cl[m - 1] + h * sl[m - 1];
+                        const float dd = g * sl[m - 1] - h * cl[m - 1];
+                        xn += cc * qn[m];
+                        zn += cc * pn[m];
+                        if (polar)
+                                yn += dd * qn[m];
+                        else
+                                yn += dd * m * pn[m];
+                }
+
+                rr *= ratio;
+                x += rr * xn;
+                y += rr * yfactor * yn;
+                z -= (n + 1.f) * rr * zn;
+        }
+
+        /* Rotate to geodetic and fill. */
+        const float cd = location->cd;
+        const float sd = location->sd;
+        magnet[0] = y * 1E-09f;
+        magnet[1] = (x * cd + z * sd) * 1E-09f;
+        magnet[2] = -(z * cd - x * sd) * 1E-09f;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot in single precision,
+ * in ENU. The kernel is specialised as `field_kernel`.
+ */
+static void field_kernel_float(const struct gull_snapshot * snapshot,
+    const struct location_float * location, double * workspace,
+    float magnet[3])
+{
+        const float * const coeff = get_coeff_float(snapshot);
+        const float * const table =
+            coeff + snapshot->order * (snapshot->order + 3);
+
+#define FIELD_SUM(order)                                                       \
+        field_sum_float(order, coeff, table, location, workspace, magnet)
+
+        switch (snapshot->order) {
+        case 13: FIELD_SUM(13); break;
+        case 12: FIELD_SUM(12); break;
+        case 10: FIELD_SUM(10); break;
+        default: FIELD_SUM(snapshot->order); break;
+        }
+
+#undef FIELD_SUM
+}
+
+enum gull_return gull_snapshot_field_float(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude, float magnet[3],
+    double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_float);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(float));
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components. */
+        if (snapshot->order > FLOAT_ORDER_MAX) {
+                struct location location;
+                location_geodetic(latitude, longitude, altitude, &location);
+                double m[3];
+                field_kernel(snapshot, &location, workspace, m);
+                int i;
+                for (i = 0; i < 3; i++) magnet[i] = (float)m[i];
+        } else {
+                struct location_float location;
+                location_geodetic_float(
+                    latitude, longitude, altitude, &location);
+                field_kernel_float(snapshot, &location, workspace, magnet);
+        }
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/*
+ * Compute the geomagnetic field components of a snapshot for a batch of points
+ * in single precision, in ENU. This is the counterpart of
+ * `snapshot_field_batch`, with groups of `LANES_FLOAT` points.
+ */
+static void snapshot_field_batch_float(const struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, float * magnet, double * workspace)
+{
+        int i = 0;
+        if (snapshot->order > FLOAT_ORDER_MAX) {
+                /* Compute in double precision by chunks, and round. */
+#define FLOAT_CHUNK (32 * LANES)
+                double m[3 * FLOAT_CHUNK];
+                for (; i < n; i += FLOAT_CHUNK, magnet += 3 * FLOAT_CHUNK) {
+                        const int k = (n - i < FLOAT_CHUNK) ? n - i :
+                                                              FLOAT_CHUNK;
+                        snapshot_field_batch(snapshot, k, latitude + i,
+                            longitude + i, altitude + i, m, workspace);
+                        int j;
+                        for (j = 0; j < 3 * k; j++) magnet[j] = (float)m[j];
+                }
+#undef FLOAT_CHUNK
+                return;
+        }
+#ifdef GULL_USE_SIMD
+        field_lanes_float_t * const kernel = field_lanes_float();
+        const float * const coeff = get_coeff_float(snapshot);
+        const float * const table =
+            coeff + snapshot->order * (snapshot->order + 3);
+        for (; i + LANES_FLOAT <= n; i += LANES_FLOAT,
+             magnet += 3 * LANES_FLOAT) {
+                struct location_lanes_float location;
+                int l;
+                for (l = 0; l < LANES_FLOAT; l++) {
+                        struct location_float point;
+                        location_geodetic_float(latitude[i + l],
+                            longitude[i + l], altitude[i + l] * 1E-03, &point);
+                        location_lanes_float_set(&location, l, &point);
+                }
+                kernel(snapshot->order, coeff, NULL, NULL, table, &location,
+                    workspace, magnet);
+        }
+#endif
+        for (; i < n; i++, magnet += 3) {
+                struct location_float location;
+                location_geodetic_float(
+                    latitude[i], longitude[i], altitude[i] * 1E-03, &location);
+                field_kernel_float(snapshot, &location, workspace, magnet);
+        }
+}
+
+enum gull_return gull_snapshot_field_float_v(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, float * magnet, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_float_v);
+        STATS_START();
+        if (n <= 0) return GULL_RETURN_SUCCESS;
+
+        /* Configure the temporary work memory, once for all points. */
+        const int order = snapshot->order;
+        double * workspace = workspace_configure(
+            (order > FLOAT_ORDER_MAX) ? workspace_size_batch(order) :
+                                        workspace_size_lanes(order),
+            workspace_);
+        if (workspace == NULL) {
+                memset(magnet, 0x0, 3 * (size_t)n * sizeof(*magnet));
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Check the altitudes. */
+        const double altmin = snapshot->altmin;
+        const double altmax = snapshot->altmax;
+        int i, invalid = -1;
+        for (i = 0; i < n; i++) {
+                const double z = altitude[i] * 1E-03; /* m -> km. */
+                if ((z < altmin) || (z > altmax)) {
+                        invalid = i;
+                        break;
+                }
+        }
+
+        /* Compute the magnetic field components. */
+        snapshot_field_batch_float(
+            snapshot, n, latitude, longitude, altitude, magnet, workspace);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(n);
+
+        if (invalid >= 0) {
+                STATS_DOMAIN(n - invalid, altitude + invalid, altmin, altmax);
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE [index %d]",
+                    altitude[invalid] * 1E-03, invalid);
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/* Get the coordinate of node *i* over a regular range of *n* nodes. */
+static inline double map_node(const double range[2], int n, int i)
+{
+        return (n > 1) ? range[0] + i * (range[1] - range[0]) / (n - 1) :
+                         range[0];
+}
+
+enum gull_return gull_snapshot_field_map(struct gull_snapshot * snapshot,
+    double altitude, const double latitude[2], int n_latitude,
+    const double longitude[2], int n_longitude, int row, int n_rows,
+    double * magnet)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_map);
+        STATS_START();
+
+        /* Check the map and the block of rows. */
+        if ((n_latitude <= 0) || (n_longitude <= 0) || (row < 0) ||
+            (n_rows < 0) || (row > n_latitude - n_rows)) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid map rows: [%d, %d[ over %d", row, row + n_rows,
+                    n_latitude);
+        }
+        if (n_rows == 0) return GULL_RETURN_SUCCESS;
+
+        /* Tabulate the longitudes, shared by all rows. */
+        double * const lon = malloc(n_longitude * sizeof(*lon));
+        if (lon == NULL) {
+                memset(magnet, 0x0,
+                    3 * (size_t)n_rows * n_longitude * sizeof(*magnet));
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        int j;
+        for (j = 0; j < n_longitude; j++)
+                lon[j] = map_node(longitude, n_longitude, j);
+
+        /*
+         * Compute the rows, in parallel if OpenMP is enabled. Each thread
+         * manages its own workspace, and the latitude and altitude of its
+         * current row.
+         */
+        int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+                double * workspace = workspace_configure(
+                    workspace_size_batch(snapshot->order), NULL);
+                double * const lat = malloc(2 * n_longitude * sizeof(*lat));
+                double * const alt = (lat == NULL) ? NULL : lat + n_longitude;
+                const int ready = (workspace != NULL) && (lat != NULL);
+                int i, k;
+                if (ready) {
+                        for (k = 0; k < n_longitude; k++) alt[k] = altitude;
+                } else {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+                        failed = 1;
+                }
+
+                /*
+                 * Note that all threads must reach the worksharing loop, thus
+                 * a thread without memory only skips its body. The map is
+                 * zeroed in this case.
+                 */
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                for (i = 0; i < n_rows; i++) {
+                        if (!ready) continue;
+                        const double l =
+                            map_node(latitude, n_latitude, row + i);
+                        for (k = 0; k < n_longitude; k++) lat[k] = l;
+                        snapshot_field_batch(snapshot, n_longitude, lat, lon,
+                            alt, magnet + 3 * (size_t)i * n_longitude,
+                            workspace);
+                }
+                free(lat);
+                free(workspace);
+        }
+        free(lon);
+        STATS_FIELD((unsigned long long)n_rows * n_longitude);
+
+        if (failed) {
+                memset(magnet, 0x0,
+                    3 * (size_t)n_rows * n_longitude * sizeof(*magnet));
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Check the altitude. */
+        if ((altitude * 1E-03 < snapshot->altmin) ||
+            (altitude * 1E-03 > snapshot->altmax)) {
+                STATS_ADD(domain_points, (unsigned long long)n_rows *
+                    n_longitude);
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude * 1E-03);
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/* The mask of all derived quantities. */
+#define QUANTITY_ALL ((1U << GULL_N_QUANTITIES) - 1)
+
+/*
+ * Fill the requested quantities, derived from the E, N, U components of the
+ * field. The number of values filled is returned.
+ */
+static int derived_fill(unsigned int quantities, double latitude,
+    double longitude, const double magnet[3], double * values)
+{
+        const double deg = 180. / M_PI;
+        const double e = magnet[0], n = magnet[1], u = magnet[2];
+        const double h2 = e * e + n * n;
+        int k = 0;
+
+        if (quantities & GULL_QUANTITY_EAST) values[k++] = e;
+        if (quantities & GULL_QUANTITY_NORTH) values[k++] = n;
+        if (quantities & GULL_QUANTITY_UP) values[k++] = u;
+
+        const double h = (quantities &
+                             (GULL_QUANTITY_INCLINATION | GULL_QUANTITY_H)) ?
+            sqrt(h2) :
+            0.;
+        const double d =
+            (quantities & (GULL_QUANTITY_DECLINATION | GULL_QUANTITY_GRID)) ?
+            atan2(e, n) * deg :
+            0.;
+        if (quantities & GULL_QUANTITY_DECLINATION) values[k++] = d;
+        if (quantities & GULL_QUANTITY_INCLINATION)
+                values[k++] = atan2(-u, h) * deg;
+        if (quantities & GULL_QUANTITY_H) values[k++] = h;
+        if (quantities & GULL_QUANTITY_F) values[k++] = sqrt(h2 + u * u);
+
+        if (quantities & GULL_QUANTITY_GRID) {
+                /*
+                 * The grid variation is referenced to the polar stereographic
+                 * grids, as for the WMM. It is undefined at lower latitudes.
+                 */
+                double gv;
+                if (latitude >= 55.)
+                        gv = d - longitude;
+                else if (latitude <= -55.)
+                        gv = d + longitude;
+                else
+                        gv = NAN;
+                if (gv > 180.)
+                        gv -= 360. * ceil((gv - 180.) / 360.);
+                else if (gv <= -180.)
+                        gv += 360. * ceil((-180. - gv) / 360.);
+                values[k++] = gv;
+        }
+
+        return k;
+}
+
+enum gull_return gull_snapshot_field_derived(struct gull_snapshot * snapshot,
+    double latitude, double longitude, double altitude,
+    unsigned int quantities, double * values, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_derived);
+        STATS_START();
+
+        if ((quantities == 0) || (quantities & ~QUANTITY_ALL)) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid quantities: 0x%X", quantities);
+        }
+
+        /* Check the altitude. */
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < snapshot->altmin) || (altitude > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double magnet[3] = { 0., 0., 0. };
+        double * workspace = workspace_configure(
+            workspace_size(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                derived_fill(quantities, latitude, longitude, magnet, values);
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components, and derive the quantities. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        field_kernel(snapshot, &location, workspace, magnet);
+        derived_fill(quantities, latitude, longitude, magnet, values);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_snapshot_field_derived_v(struct gull_snapshot * snapshot,
+    int n, const double * latitude, const double * longitude,
+    const double * altitude, unsigned int quantities, double * values,
+    double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_snapshot_field_derived_v);
+        STATS_START();
+        if (n <= 0) return GULL_RETURN_SUCCESS;
+
+        if ((quantities == 0) || (quantities & ~QUANTITY_ALL)) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid quantities: 0x%X", quantities);
+        }
+
+        /* Configure the temporary work memory, once for all points. */
+        double * workspace = workspace_configure(
+            workspace_size_batch(snapshot->order), workspace_);
+        if (workspace == NULL) {
+                size_t k = 0;
+                int i;
+                for (i = 0; i < n; i++) {
+                        double magnet[3] = { 0., 0., 0. };
+                        k += derived_fill(quantities, latitude[i],
+                            longitude[i], magnet, values + k);
+                }
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Check the altitudes. */
+        const double altmin = snapshot->altmin;
+        const double altmax = snapshot->altmax;
+        int i, invalid = -1;
+        for (i = 0; i < n; i++) {
+                const double z = altitude[i] * 1E-03; /* m -> km. */
+                if ((z < altmin) || (z > altmax)) {
+                        invalid = i;
+                        break;
+                }
+        }
+
+        /*
+         * Compute the magnetic field components by chunks, and derive the
+         * quantities. Thus, the components are never stored for the whole
+         * batch.
+         */
+#define DERIVED_CHUNK (8 * LANES)
+        double magnet[3 * DERIVED_CHUNK];
+        size_t k = 0;
+        for (i = 0; i < n; i += DERIVED_CHUNK) {
+                const int m = (i + DERIVED_CHUNK <= n) ? DERIVED_CHUNK : n - i;
+                snapshot_field_batch(snapshot, m, latitude + i, longitude + i,
+                    altitude + i, magnet, workspace);
+                int j;
+                for (j = 0; j < m; j++) {
+                        k += derived_fill(quantities, latitude[i + j],
+                            longitude[i + j], magnet + 3 * j, values + k);
+                }
+        }
+#undef DERIVED_CHUNK
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(n);
+
+        if (invalid >= 0) {
+                STATS_DOMAIN(n - invalid, altitude + invalid, altmin, altmax);
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE [index %d]",
+                    altitude[invalid] * 1E-03, invalid);
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/* Size of the temporary workspace, in bytes. */
+size_t gull_snapshot_workspace_size(struct gull_snapshot * snapshot)
+{
+        return workspace_size(snapshot->order) * sizeof(double);
+}
+
+/* Export the coefficients of a snapshot by columns. */
+size_t gull_snapshot_columns(struct gull_snapshot * snapshot, double * columns)
+{
+        const int order = snapshot->order;
+        const size_t npq = (order * (order + 3)) / 2;
+        /* Pack the four arrays of the columns, without padding. */
+        if (columns != NULL) columns_fill(snapshot, columns, npq);
+        return 4 * npq;
+}
+
+/* Information on a geomagnetic snapshot. */
+void gull_snapshot_info(struct gull_snapshot * snapshot, int * order,
     double * altitude_min, double * altitude_max)
 {
-        if (order != NULL) *order = snapshot->order;
-        if (altitude_min != NULL) *altitude_min = snapshot->altmin * 1E+03;
-        if (altitude_max != NULL) *altitude_max = snapshot->altmax * 1E+03;
+        if (order != NULL) *order = snapshot->order;
+        if (altitude_min != NULL) *altitude_min = snapshot->altmin * 1E+03;
+        if (altitude_max != NULL) *altitude_max = snapshot->altmax * 1E+03;
+}
+
+/* Convert a calendar date to a decimal year. */
+enum gull_return gull_date_decimal(int day, int month, int year, double * date)
+{
+        GULL_ERROR_INITIALISE(gull_date_decimal);
+        date_decimal(day, month, year, date, error_);
+        return GULL_ERROR_RAISE();
+}
+
+/* Meta-data of a geomagnetic model at a given epoch, i.e. a data set. */
+struct model_epoch {
+        /* The reference date, as a decimal year. */
+        double date;
+        /* The validity period, as decimal years. */
+        double date_min, date_max;
+        /* The validity range of altitudes, in km. */
+        double altmin, altmax;
+        /*
+         * The order of the spherical harmonics over the validity period, or 0
+         * if the time dependency is unknown.
+         */
+        int order;
+};
+
+/* Low level data structure for hosting a time dependent geomagnetic model. */
+struct gull_model {
+        /* The maximum order of the spherical harmonics. */
+        int order;
+        /* The number of epochs. */
+        int n_epochs;
+        /* The epochs meta-data. */
+        struct model_epoch * epoch;
+        /*
+         * The spherical harmonic coefficients for each epoch, padded to the
+         * maximum order. The coefficients at the reference date are followed
+         * by their time derivatives, i.e. the secular variation or the slope
+         * to the next epoch.
+         */
+        double * coeff;
+        /* The recursion constants for the associated Legendre functions. */
+        double * recursion;
+        /*
+         * Flag indicating that epochs are sorted by date, with validity
+         * periods overlapping at most at their bounds.
+         */
+        int sorted;
+        /* The memory mapped data file, if any. */
+        void * map;
+        /* The size of the memory map. */
+        size_t map_size;
+        /* Binary data owned by the model, if any. */
+        void * data;
+};
+
+/* Utility function for accessing the coefficients of an epoch. */
+static inline double * model_coeff(const struct gull_model * model, int epoch)
+{
+        return model->coeff +
+            2 * (size_t)epoch * model->order * (model->order + 3);
+}
+
+/* Utility function for accessing the time derivatives of the coefficients. */
+static inline double * model_slope(const struct gull_model * model, int epoch)
+{
+        return model_coeff(model, epoch) + model->order * (model->order + 3);
+}
+
+/*
+ * Locate the epoch relevant for a given date. The first epoch, in file order,
+ * whose validity period contains the date is returned, or -1 if there is none.
+ *
+ * If the epochs are sorted, the *hint* epoch, e.g. from a previous call, is
+ * checked first. Set *hint* to -1 for a full search.
+ */
+static int model_epoch_locate(
+    const struct gull_model * model, double date, int hint)
+{
+        if (model->sorted && (hint >= 0)) {
+                const struct model_epoch * epoch = model->epoch + hint;
+                if (((date > epoch->date_min) ||
+                        ((hint == 0) && (date == epoch->date_min))) &&
+                    (date <= epoch->date_max))
+                        return hint;
+        }
+
+        int i;
+        for (i = 0; i < model->n_epochs; i++) {
+                const struct model_epoch * epoch = model->epoch + i;
+                if ((date >= epoch->date_min) && (date <= epoch->date_max))
+                        return (epoch->order > 0) ? i : -1;
+        }
+        return -1;
+}
+
+/* Load a geomagnetic model from an opened COF file. */
+static enum gull_return model_load_cof(struct gull_model ** model,
+    FILE * fid, const char * path, struct error_context * error_)
+{
+#define LINE_WIDTH 81
+
+        /* Locate all data sets. */
+        char buffer[LINE_WIDTH + 14];
+        struct cof_header * header = NULL;
+        long * position = NULL;
+        int * line_start = NULL;
+        int n_epochs = 0, order = 0, line = 0;
+        long n_lines = 0;
+        while (fgets(buffer, LINE_WIDTH + 12, fid)) {
+                line++;
+                if (strlen(buffer) != LINE_WIDTH) goto exit_on_syntax_error;
+                STATS_ADD(bytes_parsed, LINE_WIDTH);
+
+                /*
+                 * Skip the coefficients of the current data set, which might
+                 * start with blanks as well, e.g. with 4 wide degree and order
+                 * columns.
+                 */
+                if (n_lines > 0) {
+                        n_lines--;
+                        continue;
+                }
+                if (strncmp(buffer, "   ", 3) != 0) continue;
+
+                /* This is a new data set. Let's parse its header. */
+                if ((n_epochs % 32) == 0) {
+                        const int n = n_epochs + 32;
+                        void * tmp;
+                        if ((tmp = realloc(header, n * sizeof(*header))) ==
+                            NULL)
+                                goto exit_on_memory_error;
+                        header = tmp;
+                        if ((tmp = realloc(position, n * sizeof(*position))) ==
+                            NULL)
+                                goto exit_on_memory_error;
+                        position = tmp;
+                        if ((tmp = realloc(line_start,
+                                 n * sizeof(*line_start))) == NULL)
+                                goto exit_on_memory_error;
+                        line_start = tmp;
+                }
+                struct cof_header * h = header + n_epochs;
+                if (!cof_parse_header(buffer, h) || (h->nmax1 < 1) ||
+                    (h->nmax1 > ORDER_MAX) || (h->nmax2 > ORDER_MAX))
+                        goto exit_on_syntax_error;
+                if (h->nmax1 > order) order = h->nmax1;
+                if (h->nmax2 > order) order = h->nmax2;
+                const int nmax = (h->nmax1 > h->nmax2) ? h->nmax1 : h->nmax2;
+                n_lines = (nmax * (nmax + 3L)) / 2;
+                position[n_epochs] = ftell(fid);
+                line_start[n_epochs] = line;
+                n_epochs++;
+        }
+        if (n_epochs == 0) {
+                GULL_ERROR_VREGISTER(GULL_RETURN_MISSING_DATA,
+                    "missing data in file `%s`", path);
+                goto exit_on_error;
+        }
+
+        /* Allocate the model, as a single memory block. */
+        const size_t npq = ((size_t)order * (order + 3)) / 2;
+        const size_t size = sizeof(**model) +
+            n_epochs * sizeof(*(*model)->epoch) +
+            (2 * n_epochs + 1) * 2 * npq * sizeof(double);
+        *model = malloc(size);
+        if (*model == NULL) goto exit_on_memory_error;
+        memset(*model, 0x0, size);
+        (*model)->order = order;
+        (*model)->n_epochs = n_epochs;
+        (*model)->epoch = (void *)(*model + 1);
+        (*model)->coeff = (void *)((*model)->epoch + n_epochs);
+        (*model)->recursion = (*model)->coeff + 4 * n_epochs * npq;
+        recursion_initialise(order, (*model)->recursion);
+
+        /* Read the spherical harmonic coefficients of all data sets. */
+        int idat;
+        for (idat = 0; idat < n_epochs; idat++) {
+                fseek(fid, position[idat], SEEK_SET);
+                line = line_start[idat];
+
+                const struct cof_header * h = header + idat;
+                const int nmax = (h->nmax1 > h->nmax2) ? h->nmax1 : h->nmax2;
+                const int nc = (nmax * (nmax + 3)) / 2;
+                double * const c0 = model_coeff(*model, idat);
+                double * const c1 = model_slope(*model, idat);
+                int ic;
+                for (ic = 0; ic < nc; ic++) {
+                        /* Read a new line. */
+                        line++;
+                        if (!fgets(buffer, LINE_WIDTH + 12, fid))
+                                goto exit_on_syntax_error;
+                        if (strlen(buffer) != LINE_WIDTH)
+                                goto exit_on_syntax_error;
+                        STATS_ADD(bytes_parsed, LINE_WIDTH);
+
+                        /* Parse the line. */
+                        int i, j;
+                        double values[4];
+                        if (!cof_parse_line(buffer, &i, &j, values) ||
+                            (i < 1) || (j < 0) || (j > i) || (i > nmax))
+                                goto exit_on_syntax_error;
+                        const double g1 = values[0], h1 = values[1];
+                        const double g2 = values[2], h2 = values[3];
+                        const int k = (i * (i + 1)) / 2 - 1 + j;
+                        double * p = c0 + 2 * k;
+                        if ((p[0] != 0.) || (p[1] != 0.))
+                                /* Check for a duplicated line. */
+                                goto exit_on_syntax_error;
+                        p[0] = g1;
+                        p[1] = h1;
+                        if (h->nmax2 > 0) {
+                                p = c1 + 2 * k;
+                                p[0] = g2;
+                                p[1] = h2;
+                        }
+                }
+        }
+        /*
+         * Set the validity of each epoch. Data sets without secular variation
+         * are interpolated to the next one, as done by gull_snapshot_create.
+         */
+        (*model)->sorted = 1;
+        for (idat = 0; idat < n_epochs; idat++) {
+                const struct cof_header * h = header + idat;
+                struct model_epoch * epoch = (*model)->epoch + idat;
+                if ((idat > 0) && (h->yrmin < (h - 1)->yrmax))
+                        (*model)->sorted = 0;
+                epoch->date = h->epoch;
+                epoch->date_min = h->yrmin;
+                epoch->date_max = h->yrmax;
+                if (h->nmax2 > 0) {
+                        epoch->order = (h->nmax1 > h->nmax2) ? h->nmax1 :
+                                                               h->nmax2;
+                        epoch->altmin = h->altmin;
+                        epoch->altmax = h->altmax;
+                } else if (idat < n_epochs - 1) {
+                        const struct cof_header * next = h + 1;
+                        epoch->order =
+                            (h->nmax1 > next->nmax1) ? h->nmax1 : next->nmax1;
+                        epoch->altmin = (h->altmin > next->altmin) ?
+                            h->altmin :
+                            next->altmin;
+                        epoch->altmax = (h->altmax < next->altmax) ?
+                            h->altmax :
+                            next->altmax;
+
+                        const double dt = next->epoch - h->epoch;
+                        const double * const c0 = model_coeff(*model, idat);
+                        const double * const c2 =
+                            model_coeff(*model, idat + 1);
+                        double * const c1 = model_slope(*model, idat);
+                        size_t ic;
+                        for (ic = 0; ic < 2 * npq; ic++)
+                                c1[ic] = (c2[ic] - c0[ic]) / dt;
+                } else {
+                        /* The time dependency is unknown. */
+                        epoch->order = 0;
+                }
+        }
+
+        free(header);
+        free(position);
+        free(line_start);
+
+        return GULL_RETURN_SUCCESS;
+
+exit_on_syntax_error:
+        GULL_ERROR_VREGISTER(
+            GULL_RETURN_FORMAT_ERROR, "invalid syntax [%s:%d]", path, line);
+        goto exit_on_error;
+
+exit_on_memory_error:
+        GULL_ERROR_REGISTER(
+            GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+
+exit_on_error:
+        free(header);
+        free(position);
+        free(line_start);
+        gull_model_destroy(model);
+        return error_->code;
+
+#undef LINE_WIDTH
+}
+
+/*
+ * Layout of binary model files.
+ *
+ * Binary files start with a fixed size header. It is followed by the epochs
+ * meta-data, as 6 doubles per epoch, and then by the model coefficients and
+ * recursion constants, as in memory. Values are stored with the native byte
+ * order, which is checked when loading.
+ */
+#define BINARY_MAGIC "GULLBIN1"
+#define BINARY_BYTE_ORDER 0x01020304
+#define BINARY_EPOCH_SIZE 6
+
+struct binary_header {
+        /* The file magic, i.e. BINARY_MAGIC. */
+        char magic[8];
+        /* Tag for checking the byte order. */
+        int32_t byte_order;
+        /* The maximum order of the spherical harmonics. */
+        int32_t order;
+        /* The number of epochs. */
+        int32_t n_epochs;
+        /* Flag indicating if epochs are sorted. */
+        int32_t sorted;
+};
+
+/* The size of the coefficients and recursion constants, in doubles. */
+static size_t model_data_size(int order, int n_epochs)
+{
+        const size_t npq = ((size_t)order * (order + 3)) / 2;
+        return (4 * (size_t)n_epochs + 2) * npq;
+}
+
+/* Check if an opened file is in binary format. The file is rewinded. */
+static int file_is_binary(FILE * fid)
+{
+        char magic[sizeof(BINARY_MAGIC) - 1];
+        const size_t n = fread(magic, 1, sizeof(magic), fid);
+        rewind(fid);
+        return (n == sizeof(magic)) &&
+            (memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0);
+}
+
+/*
+ * Load a geomagnetic model from binary data in memory. The data are not
+ * copied. Thus, they must outlive the model.
+ */
+static enum gull_return model_load_memory(struct gull_model ** model,
+    const void * data, size_t size, const char * path,
+    struct error_context * error_)
+{
+        /* Check the header. */
+        struct binary_header header;
+        if (size < sizeof(header)) goto exit_on_format_error;
+        memcpy(&header, data, sizeof(header));
+        if ((memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0) ||
+            (header.byte_order != BINARY_BYTE_ORDER) || (header.order < 1) ||
+            (header.order > ORDER_MAX) || (header.n_epochs < 1))
+                goto exit_on_format_error;
+
+        const int n_epochs = header.n_epochs;
+        const size_t offset = sizeof(header) +
+            n_epochs * BINARY_EPOCH_SIZE * sizeof(double);
+        const size_t data_size =
+            model_data_size(header.order, n_epochs) * sizeof(double);
+        if (size != offset + data_size) goto exit_on_format_error;
+
+        /* Allocate the model. */
+        const size_t model_size =
+            sizeof(**model) + n_epochs * sizeof(*(*model)->epoch);
+        *model = malloc(model_size);
+        if (*model == NULL) {
+                return GULL_ERROR_REGISTER(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        memset(*model, 0x0, model_size);
+        (*model)->order = header.order;
+        (*model)->n_epochs = n_epochs;
+        (*model)->sorted = header.sorted;
+        (*model)->epoch = (void *)(*model + 1);
+
+        /* Decode the epochs meta-data. */
+        const char * const bytes = data;
+        int i;
+        for (i = 0; i < n_epochs; i++) {
+                double values[BINARY_EPOCH_SIZE];
+                memcpy(values,
+                    bytes + sizeof(header) + i * sizeof(values),
+                    sizeof(values));
+                struct model_epoch * epoch = (*model)->epoch + i;
+                epoch->date = values[0];
+                epoch->date_min = values[1];
+                epoch->date_max = values[2];
+                epoch->altmin = values[3];
+                epoch->altmax = values[4];
+                epoch->order = (int)values[5];
+                if ((epoch->order < 0) || (epoch->order > header.order)) {
+                        gull_model_destroy(model);
+                        goto exit_on_format_error;
+                }
+        }
+
+        /* Point to the coefficients, which are never modified. */
+        (*model)->coeff = (double *)(bytes + offset);
+        (*model)->recursion =
+            (*model)->coeff +
+            2 * (size_t)n_epochs * header.order * (header.order + 3);
+
+        return GULL_RETURN_SUCCESS;
+
+exit_on_format_error:
+        return GULL_ERROR_VREGISTER(
+            GULL_RETURN_FORMAT_ERROR, "invalid binary data `%s`", path);
+}
+
+/*
+ * Load a geomagnetic model from an opened binary file. If supported, the file
+ * is memory mapped, read only. Otherwise it is copied.
+ */
+static enum gull_return model_load_binary(struct gull_model ** model,
+    FILE * fid, const char * path, struct error_context * error_)
+{
+        long size;
+        if ((fseek(fid, 0, SEEK_END) != 0) || ((size = ftell(fid)) <= 0)) {
+                return GULL_ERROR_VREGISTER(GULL_RETURN_FORMAT_ERROR,
+                    "invalid binary data `%s`", path);
+        }
+        rewind(fid);
+
+#ifdef GULL_USE_MMAP
+        void * data =
+            mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fid), 0);
+        if (data == MAP_FAILED) {
+                return GULL_ERROR_VREGISTER(GULL_RETURN_MEMORY_ERROR,
+                    "could not map file `%s`", path);
+        }
+        if (model_load_memory(model, data, size, path, error_) !=
+            GULL_RETURN_SUCCESS) {
+                munmap(data, size);
+                return error_->code;
+        }
+        (*model)->map = data;
+        (*model)->map_size = size;
+#else
+        void * data = malloc(size);
+        if (data == NULL) {
+                return GULL_ERROR_REGISTER(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        if ((fread(data, size, 1, fid) != 1) ||
+            (model_load_memory(model, data, size, path, error_) !=
+                GULL_RETURN_SUCCESS)) {
+                free(data);
+                return GULL_ERROR_VREGISTER(GULL_RETURN_FORMAT_ERROR,
+                    "invalid binary data `%s`", path);
+        }
+        (*model)->data = data;
+#endif
+
+        return GULL_RETURN_SUCCESS;
+}
+
+#ifdef GULL_EMBED_MODELS
+/* Builtin model data, compiled in as a binary image. */
+struct builtin_model {
+        /* The model name, e.g. IGRF13. */
+        const char * name;
+        /* The binary data, as doubles in native order. */
+        const double * data;
+        /* The size of the binary data, in bytes. */
+        size_t size;
+};
+
+/* Tables generated by gull-embed at build time. */
+#include "gull-models.inc"
+#endif
+
+enum gull_return gull_model_create_builtin(
+    struct gull_model ** model, const char * name)
+{
+        GULL_ERROR_INITIALISE(gull_model_create_builtin);
+        *model = NULL;
+
+#ifdef GULL_EMBED_MODELS
+        const int n = sizeof(builtin_models) / sizeof(*builtin_models);
+        int i;
+        for (i = 0; i < n; i++) {
+                const struct builtin_model * builtin = builtin_models + i;
+                if ((name != NULL) && (strcmp(name, builtin->name) != 0))
+                        continue;
+                model_load_memory(
+                    model, builtin->data, builtin->size, builtin->name, error_);
+                return GULL_ERROR_RAISE();
+        }
+#endif
+        return GULL_ERROR_FORMAT(GULL_RETURN_MISSING_DATA,
+            "no builtin model `%s`", (name == NULL) ? "(null)" : name);
+}
+
+/* Load a geomagnetic model from a data file. */
+static enum gull_return model_load(struct gull_model ** model,
+    const char * path, struct error_context * error_)
+{
+        *model = NULL;
+
+        /* Open the data file. */
+        FILE * fid;
+        if ((fid = fopen(path, "r")) == NULL) {
+                return GULL_ERROR_VREGISTER(
+                    GULL_RETURN_PATH_ERROR, "could not open file `%s`", path);
+        }
+
+        /* Load the data according to the file format. */
+        if (file_is_binary(fid)) {
+                fclose(fid);
+                if ((fid = fopen(path, "rb")) == NULL) {
+                        return GULL_ERROR_VREGISTER(GULL_RETURN_PATH_ERROR,
+                            "could not open file `%s`", path);
+                }
+                model_load_binary(model, fid, path, error_);
+        } else {
+                model_load_cof(model, fid, path, error_);
+        }
+        fclose(fid);
+
+        return error_->code;
+}
+
+enum gull_return gull_model_create(struct gull_model ** model, const char * path)
+{
+        GULL_ERROR_INITIALISE(gull_model_create);
+        model_load(model, path, error_);
+        return GULL_ERROR_RAISE();
+}
+
+void gull_model_destroy(struct gull_model ** model)
+{
+        if ((model == NULL) || (*model == NULL)) return;
+#ifdef GULL_USE_MMAP
+        if ((*model)->map != NULL) munmap((*model)->map, (*model)->map_size);
+#endif
+        free((*model)->data);
+        free(*model);
+        *model = NULL;
+}
+
+enum gull_return gull_model_dump(struct gull_model * model, const char * path)
+{
+        GULL_ERROR_INITIALISE(gull_model_dump);
+
+        FILE * fid;
+        if ((fid = fopen(path, "wb")) == NULL) {
+                return GULL_ERROR_FORMAT(
+                    GULL_RETURN_PATH_ERROR, "could not open file `%s`", path);
+        }
+
+        /* Write the header and the epochs meta-data. */
+        struct binary_header header;
+        memset(&header, 0x0, sizeof(header));
+        memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+        header.byte_order = BINARY_BYTE_ORDER;
+        header.order = model->order;
+        header.n_epochs = model->n_epochs;
+        header.sorted = model->sorted;
+        if (fwrite(&header, sizeof(header), 1, fid) != 1) goto exit_on_error;
+
+        int i;
+        for (i = 0; i < model->n_epochs; i++) {
+                const struct model_epoch * epoch = model->epoch + i;
+                const double data[BINARY_EPOCH_SIZE] = { epoch->date,
+                        epoch->date_min, epoch->date_max, epoch->altmin,
+                        epoch->altmax, epoch->order };
+                if (fwrite(data, sizeof(data), 1, fid) != 1)
+                        goto exit_on_error;
+        }
+
+        /* Write the coefficients and the recursion constants. */
+        const size_t n = model_data_size(model->order, model->n_epochs);
+        if (fwrite(model->coeff, sizeof(*model->coeff), n, fid) != n)
+                goto exit_on_error;
+
+        if (fclose(fid) != 0) {
+                return GULL_ERROR_FORMAT(
+                    GULL_RETURN_PATH_ERROR, "could not write file `%s`", path);
+        }
+        return GULL_RETURN_SUCCESS;
+
+exit_on_error:
+        fclose(fid);
+        return GULL_ERROR_FORMAT(
+            GULL_RETURN_PATH_ERROR, "could not write file `%s`", path);
+}
+
+/* Compute a snapshot of a geomagnetic model. */
+static enum gull_return model_snapshot(struct gull_model * model, double date,
+    struct gull_snapshot ** snapshot, struct error_context * error_)
+{
+        /* Locate the relevant epoch. */
+        const int index = model_epoch_locate(model, date, -1);
+        if (index < 0) {
+                return GULL_ERROR_VREGISTER(GULL_RETURN_MISSING_DATA,
+                    "missing data for date %.5lf", date);
+        }
+        const struct model_epoch * epoch = model->epoch + index;
+
+        /*
+         * (Re)allocate the snapshot, if needed. Note that a shared snapshot is
+         * released, instead of being overwritten.
+         */
+        const int order = epoch->order;
+        if ((*snapshot != NULL) && ((*snapshot)->share != NULL))
+                gull_snapshot_destroy(snapshot);
+        if ((*snapshot == NULL) || ((*snapshot)->order != order)) {
+                struct gull_snapshot * tmp =
+                    realloc(*snapshot, snapshot_size(order));
+                if (tmp == NULL) {
+                        return GULL_ERROR_REGISTER(GULL_RETURN_MEMORY_ERROR,
+                            "could not allocate memory");
+                }
+                *snapshot = tmp;
+                (*snapshot)->order = order;
+                (*snapshot)->share = NULL;
+        }
+        (*snapshot)->altmin = epoch->altmin;
+        (*snapshot)->altmax = epoch->altmax;
+
+        /* Interpolate or extrapolate the coefficients. */
+        const int nc = order * (order + 3);
+        const double h = date - epoch->date;
+        const double * const c0 = model_coeff(model, index);
+        const double * const c1 = model_slope(model, index);
+        double * const coeff = (*snapshot)->coeff;
+        int ic;
+        for (ic = 0; ic < nc; ic++) coeff[ic] = c0[ic] + c1[ic] * h;
+        memcpy(get_slope(*snapshot), c1, nc * sizeof(*c1));
+
+        /* Copy the recursion constants. */
+        memcpy(get_recursion(*snapshot), model->recursion,
+            nc * sizeof(*model->recursion));
+        spectrum_initialise(order, coeff, get_spectrum(*snapshot));
+        float_initialise(*snapshot);
+        columns_initialise(*snapshot);
+        STATS_ADD(snapshot_creations, 1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_model_snapshot(
+    struct gull_model * model, double date, struct gull_snapshot ** snapshot)
+{
+        GULL_ERROR_INITIALISE(gull_model_snapshot);
+        STATS_START();
+        model_snapshot(model, date, snapshot, error_);
+        STATS_STOP(create_time);
+        return GULL_ERROR_RAISE();
+}
+
+/* Compute the geomagnetic field components of a model, in ENU. */
+static void model_kernel(const struct gull_model * model, int index,
+    double date, const struct location * location, double * workspace,
+    double magnet[3])
+{
+        const struct model_epoch * epoch = model->epoch + index;
+        const double * const coeff = model_coeff(model, index);
+        const double * const slope = model_slope(model, index);
+        const double dt = date - epoch->date;
+
+#define FIELD_SUM(order)                                                       \
+        field_sum(order, coeff, slope, dt, model->recursion, location,         \
+            workspace, magnet, NULL, NULL)
+
+        /* Specialise the kernel as for snapshots. */
+        switch (epoch->order) {
+        case 13: FIELD_SUM(13); break;
+        case 12: FIELD_SUM(12); break;
+        case 10: FIELD_SUM(10); break;
+        default: FIELD_SUM(epoch->order); break;
+        }
+
+#undef FIELD_SUM
+}
+
+enum gull_return gull_model_field(struct gull_model * model, double date,
+    double latitude, double longitude, double altitude, double magnet[3],
+    double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_model_field);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+
+        /* Locate the relevant epoch. */
+        const int index = model_epoch_locate(model, date, -1);
+        if (index < 0) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_MISSING_DATA,
+                    "missing data for date %.5lf", date);
+        }
+
+        /* Check the altitude. */
+        const struct model_epoch * epoch = model->epoch + index;
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < epoch->altmin) || (altitude > epoch->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(model->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /* Compute the magnetic field components. */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        model_kernel(model, index, date, &location, workspace, magnet);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_model_field_rate(struct gull_model * model, double date,
+    double latitude, double longitude, double altitude, double magnet[3],
+    double rate[3], double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_model_field_rate);
+        STATS_START();
+        memset(magnet, 0x0, 3 * sizeof(double));
+        memset(rate, 0x0, 3 * sizeof(double));
+
+        /* Locate the relevant epoch. */
+        const int index = model_epoch_locate(model, date, -1);
+        if (index < 0) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_MISSING_DATA,
+                    "missing data for date %.5lf", date);
+        }
+
+        /* Check the altitude. */
+        const struct model_epoch * epoch = model->epoch + index;
+        altitude *= 1E-03; /* m -> km. */
+        if ((altitude < epoch->altmin) || (altitude > epoch->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", altitude);
+        }
+
+        /* Configure the temporary work memory. */
+        double * workspace = workspace_configure(
+            workspace_size(model->order), workspace_);
+        if (workspace == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /*
+         * Compute the magnetic field components and their time derivatives.
+         * Note that this kernel is not specialised.
+         */
+        struct location location;
+        location_geodetic(latitude, longitude, altitude, &location);
+        field_sum(epoch->order, model_coeff(model, index),
+            model_slope(model, index), date - epoch->date, model->recursion,
+            &location, workspace, magnet, rate, NULL);
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(1);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+enum gull_return gull_model_field_v(struct gull_model * model, int n,
+    const double * date, const double * latitude, const double * longitude,
+    const double * altitude, double * magnet, double ** workspace_)
+{
+        GULL_ERROR_INITIALISE(gull_model_field_v);
+        STATS_START();
+        if (n <= 0) return GULL_RETURN_SUCCESS;
+
+        /* Configure the temporary work memory, once for all points. */
+        double * workspace = workspace_configure(
+            workspace_size_lanes(model->order), workspace_);
+        if (workspace == NULL) {
+                memset(magnet, 0x0, 3 * (size_t)n * sizeof(*magnet));
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+
+        /*
+         * Compute the magnetic field components, by groups of points.
+         * Successive points sharing the same epoch do not require any search.
+         * Groups of points spanning several epochs, or with missing data, are
+         * computed point by point.
+         */
+#ifdef GULL_USE_SIMD
+        field_lanes_t * const kernel = field_lanes();
+#endif
+        int i, index = -1, invalid = -1;
+        enum gull_return rc = GULL_RETURN_SUCCESS;
+        for (i = 0; i < n; i += LANES, magnet += 3 * LANES) {
+                const int size = (n - i < LANES) ? n - i : LANES;
+                int indices[LANES], l;
+                for (l = 0; l < size; l++) {
+                        const int j = i + l;
+                        index = model_epoch_locate(model, date[j], index);
+                        indices[l] = index;
+                        if (index < 0) {
+                                memset(magnet + 3 * l, 0x0,
+                                    3 * sizeof(*magnet));
+                                if (invalid < 0) {
+                                        invalid = j;
+                                        rc = GULL_RETURN_MISSING_DATA;
+                                }
+                                continue;
+                        }
+
+                        const struct model_epoch * epoch = model->epoch + index;
+                        const double z = altitude[j] * 1E-03; /* m -> km. */
+                        if ((z < epoch->altmin) || (z > epoch->altmax)) {
+                                STATS_ADD(domain_points, 1);
+                                if (invalid < 0) {
+                                        invalid = j;
+                                        rc = GULL_RETURN_DOMAIN_ERROR;
+                                }
+                        }
+                }
+
+#ifdef GULL_USE_SIMD
+                /* Vectorise full groups of points sharing the same epoch. */
+                const int k = indices[0];
+                int shared = (size == LANES) && (k >= 0);
+                for (l = 1; shared && (l < LANES); l++)
+                        shared = (indices[l] == k);
+                if (shared) {
+                        const struct model_epoch * epoch = model->epoch + k;
+                        struct location_lanes location;
+                        double dt[LANES];
+                        for (l = 0; l < LANES; l++) {
+                                const int j = i + l;
+                                struct location point;
+                                location_geodetic(latitude[j], longitude[j],
+                                    altitude[j] * 1E-03, &point);
+                                location_lanes_set(&location, l, &point);
+                                dt[l] = date[j] - epoch->date;
+                        }
+                        kernel(epoch->order, model_coeff(model, k),
+                            model_slope(model, k), dt, model->recursion,
+                            &location, workspace, magnet);
+                        continue;
+                }
+#endif
+                for (l = 0; l < size; l++) {
+                        if (indices[l] < 0) continue;
+                        const int j = i + l;
+                        struct location point;
+                        location_geodetic(latitude[j], longitude[j],
+                            altitude[j] * 1E-03, &point);
+                        model_kernel(model, indices[l], date[j], &point,
+                            workspace, magnet + 3 * l);
+                }
+        }
+
+        /* Free the temporary memory, if not claimed. */
+        if (workspace_ == NULL) free(workspace);
+        STATS_FIELD(n);
+
+        if (rc == GULL_RETURN_MISSING_DATA) {
+                return GULL_ERROR_FORMAT(rc,
+                    "missing data for date %.5lf [index %d]", date[invalid],
+                    invalid);
+        } else if (rc == GULL_RETURN_DOMAIN_ERROR) {
+                return GULL_ERROR_FORMAT(rc,
+                    "invalid altitude value: %.5lE [index %d]",
+                    altitude[invalid] * 1E-03, invalid);
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/* Size of the temporary workspace, in bytes. */
+size_t gull_model_workspace_size(struct gull_model * model)
+{
+        return workspace_size(model->order) * sizeof(double);
+}
+
+/* Information on a geomagnetic model. */
+void gull_model_info(struct gull_model * model, int * order,
+    double * date_min, double * date_max)
+{
+        if (order != NULL) *order = model->order;
+
+        double dmin = DBL_MAX, dmax = -DBL_MAX;
+        int i;
+        for (i = 0; i < model->n_epochs; i++) {
+                const struct model_epoch * epoch = model->epoch + i;
+                if (epoch->order <= 0) continue;
+                if (epoch->date_min < dmin) dmin = epoch->date_min;
+                if (epoch->date_max > dmax) dmax = epoch->date_max;
+        }
+        if (date_min != NULL) *date_min = dmin;
+        if (date_max != NULL) *date_max = dmax;
+}
+
+/*
+ * Layout of grids.
+ *
+ * The grid nodes are stored by tiles of GRID_TILE^3 cells, for locality. Each
+ * tile holds the (GRID_TILE + 1)^3 nodes bounding its cells, i.e. tiles share
+ * their boundary nodes. Thus, the 8 corners of any cell are in a single tile.
+ * Within a tile, nodes are ordered by altitude, then latitude and longitude,
+ * the latter being the fastest index. Each node holds the E, N, U components
+ * of the field.
+ */
+#define GRID_TILE 8
+#define GRID_NODES (GRID_TILE + 1)
+#define GRID_TILE_SIZE (3 * GRID_NODES * GRID_NODES * GRID_NODES)
+
+/* Container for a precomputed grid of the geomagnetic field. */
+struct gull_grid {
+        /* The lower corner of the grid, in (deg, deg, m). */
+        double origin[3];
+        /* The step of the grid along latitude, longitude and altitude. */
+        double step[3];
+        /* The inverse of the steps. */
+        double inverse[3];
+        /* The number of cells along latitude, longitude and altitude. */
+        int cells[3];
+        /* The number of tiles along latitude, longitude and altitude. */
+        int tiles[3];
+        /* The estimated interpolation error, or -1 if not estimated. */
+        double error;
+        /* The placeholder for the tiles. */
+        double data[];
+};
+
+/* Get the tile of a grid containing the cell with indices (i, j, k). */
+static inline double * grid_tile(
+    const struct gull_grid * grid, int i, int j, int k)
+{
+        const int ti = i / GRID_TILE, tj = j / GRID_TILE, tk = k / GRID_TILE;
+        const size_t index =
+            ((size_t)tk * grid->tiles[0] + ti) * grid->tiles[1] + tj;
+        return (double *)grid->data + index * GRID_TILE_SIZE;
+}
+
+/* Get the offset of node (i, j, k) within its tile. */
+static inline int grid_offset(int i, int j, int k)
+{
+        const int li = i % GRID_TILE, lj = j % GRID_TILE, lk = k % GRID_TILE;
+        return 3 * ((lk * GRID_NODES + li) * GRID_NODES + lj);
+}
+
+/*
+ * Convert a location to continuous grid coordinates, i.e. in units of cells.
+ * The longitude is wrapped modulo 360 deg. Zero is returned if the location is
+ * outside of the grid.
+ */
+static int grid_coordinates(const struct gull_grid * grid, double latitude,
+    double longitude, double altitude, double uvw[3])
+{
+        double dlon = longitude - grid->origin[1];
+        if ((dlon < 0.) || (dlon >= 360.)) dlon -= 360. * floor(dlon / 360.);
+
+        uvw[0] = (latitude - grid->origin[0]) * grid->inverse[0];
+        uvw[1] = dlon * grid->inverse[1];
+        uvw[2] = (altitude - grid->origin[2]) * grid->inverse[2];
+
+        int i;
+        for (i = 0; i < 3; i++) {
+                if (!((uvw[i] >= 0.) && (uvw[i] <= grid->cells[i]))) return 0;
+        }
+        return 1;
+}
+
+/* Interpolate the field at grid coordinates, trilinearly. */
+static void grid_interpolate(
+    const struct gull_grid * grid, const double uvw[3], double magnet[3])
+{
+        /* Locate the cell, including its upper bound. */
+        int index[3];
+        double f[3];
+        int i;
+        for (i = 0; i < 3; i++) {
+                index[i] = (int)uvw[i];
+                if (index[i] >= grid->cells[i]) index[i] = grid->cells[i] - 1;
+                f[i] = uvw[i] - index[i];
+        }
+
+        /* Get the cell corners, and interpolate. */
+        const double * const c000 =
+            grid_tile(grid, index[0], index[1], index[2]) +
+            grid_offset(index[0], index[1], index[2]);
+        const double * const c100 = c000 + 3 * GRID_NODES;
+        const double * const c001 = c000 + 3 * GRID_NODES * GRID_NODES;
+        const double * const c101 = c001 + 3 * GRID_NODES;
+        for (i = 0; i < 3; i++) {
+                const double a00 = c000[i] + f[1] * (c000[i + 3] - c000[i]);
+                const double a10 = c100[i] + f[1] * (c100[i + 3] - c100[i]);
+                const double a01 = c001[i] + f[1] * (c001[i + 3] - c001[i]);
+                const double a11 = c101[i] + f[1] * (c101[i + 3] - c101[i]);
+                const double b0 = a00 + f[0] * (a10 - a00);
+                const double b1 = a01 + f[0] * (a11 - a01);
+                magnet[i] = b0 + f[2] * (b1 - b0);
+        }
+}
+
+/*
+ * Fill a tile of a grid, by rows of nodes along longitude. The workspace must
+ * be configured for batch evaluations.
+ */
+static void grid_fill(struct gull_grid * grid,
+    const struct gull_snapshot * snapshot, int tile, double * workspace)
+{
+        const int tj = tile % grid->tiles[1];
+        const int ti = (tile / grid->tiles[1]) % grid->tiles[0];
+        const int tk = tile / (grid->tiles[1] * grid->tiles[0]);
+        const int i0 = ti * GRID_TILE, j0 = tj * GRID_TILE, k0 = tk * GRID_TILE;
+        double * const data =
+            (double *)grid->data + tile * (size_t)GRID_TILE_SIZE;
+
+        double latitude[GRID_NODES], longitude[GRID_NODES];
+        double altitude[GRID_NODES];
+        int n = grid->cells[1] - j0 + 1, l;
+        if (n > GRID_NODES) n = GRID_NODES;
+        for (l = 0; l < n; l++)
+                longitude[l] = grid->origin[1] + (j0 + l) * grid->step[1];
+
+        int li, lk;
+        for (lk = 0; (lk < GRID_NODES) && (k0 + lk <= grid->cells[2]); lk++) {
+                const double z = grid->origin[2] + (k0 + lk) * grid->step[2];
+                for (li = 0; (li < GRID_NODES) && (i0 + li <= grid->cells[0]);
+                     li++) {
+                        const double lat =
+                            grid->origin[0] + (i0 + li) * grid->step[0];
+                        for (l = 0; l < n; l++) {
+                                latitude[l] = lat;
+                                altitude[l] = z;
+                        }
+                        snapshot_field_batch(snapshot, n, latitude, longitude,
+                            altitude,
+                            data + 3 * (lk * GRID_NODES + li) * GRID_NODES,
+                            workspace);
+                }
+        }
+}
+
+/*
+ * Estimate the interpolation error over the cells of a tile, from their
+ * centres. The maximum norm of the difference to the exact field is returned.
+ */
+static double grid_error(const struct gull_grid * grid,
+    const struct gull_snapshot * snapshot, int tile, double * workspace)
+{
+        const int tj = tile % grid->tiles[1];
+        const int ti = (tile / grid->tiles[1]) % grid->tiles[0];
+        const int tk = tile / (grid->tiles[1] * grid->tiles[0]);
+        const int i0 = ti * GRID_TILE, j0 = tj * GRID_TILE, k0 = tk * GRID_TILE;
+
+        double latitude[GRID_TILE], longitude[GRID_TILE], altitude[GRID_TILE];
+        double exact[3 * GRID_TILE];
+        int n = grid->cells[1] - j0, l;
+        if (n > GRID_TILE) n = GRID_TILE;
+        for (l = 0; l < n; l++)
+                longitude[l] = grid->origin[1] + (j0 + l + 0.5) * grid->step[1];
+
+        double error = 0.;
+        int li, lk;
+        for (lk = 0; (lk < GRID_TILE) && (k0 + lk < grid->cells[2]); lk++) {
+                const double w = k0 + lk + 0.5;
+                const double z = grid->origin[2] + w * grid->step[2];
+                for (li = 0; (li < GRID_TILE) && (i0 + li < grid->cells[0]);
+                     li++) {
+                        const double u = i0 + li + 0.5;
+                        const double lat = grid->origin[0] + u * grid->step[0];
+                        for (l = 0; l < n; l++) {
+                                latitude[l] = lat;
+                                altitude[l] = z;
+                        }
+                        snapshot_field_batch(snapshot, n, latitude, longitude,
+                            altitude, exact, workspace);
+
+                        for (l = 0; l < n; l++) {
+                                const double uvw[3] = { u, j0 + l + 0.5, w };
+                                double b[3];
+                                grid_interpolate(grid, uvw, b);
+                                const double * const e = exact + 3 * l;
+                                const double dx = b[0] - e[0];
+                                const double dy = b[1] - e[1];
+                                const double dz = b[2] - e[2];
+                                const double d =
+                                    sqrt(dx * dx + dy * dy + dz * dz);
+                                if (d > error) error = d;
+                        }
+                }
+        }
+        return error;
+}
+
+enum gull_return gull_grid_create(struct gull_grid ** grid,
+    struct gull_snapshot * snapshot, const double latitude[2],
+    const double longitude[2], const double altitude[2],
+    const double resolution[3], double tolerance)
+{
+        GULL_ERROR_INITIALISE(gull_grid_create);
+        *grid = NULL;
+
+        /* Check the box and the resolution. */
+        if (!((latitude[0] >= -90.) && (latitude[0] < latitude[1]) &&
+                (latitude[1] <= 90.))) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid latitude range: [%.5lf, %.5lf]", latitude[0],
+                    latitude[1]);
+        }
+        if (!((longitude[0] < longitude[1]) &&
+                (longitude[1] - longitude[0] <= 360.))) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid longitude range: [%.5lf, %.5lf]", longitude[0],
+                    longitude[1]);
+        }
+        if (!((altitude[0] >= snapshot->altmin * 1E+03) &&
+                (altitude[0] < altitude[1]) &&
+                (altitude[1] <= snapshot->altmax * 1E+03))) {
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude range: [%.5lE, %.5lE]", altitude[0],
+                    altitude[1]);
+        }
+
+        const double lower[3] = { latitude[0], longitude[0], altitude[0] };
+        const double upper[3] = { latitude[1], longitude[1], altitude[1] };
+        int cells[3], tiles[3], i;
+        size_t n_tiles = 1;
+        for (i = 0; i < 3; i++) {
+                const double n = ceil((upper[i] - lower[i]) / resolution[i]);
+                if (!((resolution[i] > 0.) && (n <= INT_MAX - GRID_TILE))) {
+                        return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                            "invalid resolution: %.5lE", resolution[i]);
+                }
+                cells[i] = (int)n;
+                tiles[i] = (cells[i] + GRID_TILE - 1) / GRID_TILE;
+                n_tiles *= tiles[i];
+        }
+
+        /* Allocate the grid. */
+        const size_t max_tiles = (SIZE_MAX - sizeof(**grid)) /
+            (GRID_TILE_SIZE * sizeof(double));
+        if ((n_tiles > max_tiles) || (n_tiles > INT_MAX)) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "grid is too large");
+        }
+        *grid = malloc(
+            sizeof(**grid) + n_tiles * GRID_TILE_SIZE * sizeof(double));
+        if (*grid == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        for (i = 0; i < 3; i++) {
+                (*grid)->origin[i] = lower[i];
+                (*grid)->step[i] = (upper[i] - lower[i]) / cells[i];
+                (*grid)->inverse[i] = 1. / (*grid)->step[i];
+                (*grid)->cells[i] = cells[i];
+                (*grid)->tiles[i] = tiles[i];
+        }
+        (*grid)->error = -1.;
+
+        /*
+         * Fill the tiles, and estimate the interpolation error if requested.
+         * This is done in parallel if OpenMP is enabled, with a workspace per
+         * thread.
+         */
+        int failed = 0;
+        double error = 0.;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+                double * workspace = workspace_configure(
+                    workspace_size_batch(snapshot->order), NULL);
+                int tile;
+                double local_error = 0.;
+
+                /*
+                 * Note that all threads must reach the worksharing loops,
+                 * thus a thread without workspace only skips their body. The
+                 * grid is discarded in this case.
+                 */
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                for (tile = 0; tile < (int)n_tiles; tile++) {
+                        if (workspace == NULL) continue;
+                        grid_fill(*grid, snapshot, tile, workspace);
+                }
+
+                if (tolerance > 0.) {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                        for (tile = 0; tile < (int)n_tiles; tile++) {
+                                if (workspace == NULL) continue;
+                                const double e = grid_error(
+                                    *grid, snapshot, tile, workspace);
+                                if (e > local_error) local_error = e;
+                        }
+                }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+                {
+                        if (workspace == NULL) failed = 1;
+                        if (local_error > error) error = local_error;
+                }
+                free(workspace);
+        }
+
+        if (failed) {
+                gull_grid_destroy(grid);
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        if (tolerance > 0.) {
+                (*grid)->error = error;
+                if (error > tolerance) {
+                        gull_grid_destroy(grid);
+                        return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                            "interpolation error exceeds tolerance "
+                            "(%.5lE > %.5lE)",
+                            error, tolerance);
+                }
+        }
+
+        return GULL_RETURN_SUCCESS;
+}
+
+void gull_grid_destroy(struct gull_grid ** grid)
+{
+        if ((grid == NULL) || (*grid == NULL)) return;
+        free(*grid);
+        *grid = NULL;
+}
+
+enum gull_return gull_grid_field(struct gull_grid * grid, double latitude,
+    double longitude, double altitude, double magnet[3])
+{
+        GULL_ERROR_INITIALISE(gull_grid_field);
+
+        double uvw[3];
+        if (!grid_coordinates(grid, latitude, longitude, altitude, uvw)) {
+                memset(magnet, 0x0, 3 * sizeof(double));
+                return GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "location is outside of the grid: (%.5lf, %.5lf, %.5lE)",
+                    latitude, longitude, altitude);
+        }
+        grid_interpolate(grid, uvw, magnet);
+
+        return GULL_RETURN_SUCCESS;
+}
+
+/* Information on a geomagnetic grid. */
+void gull_grid_info(struct gull_grid * grid, double latitude[2],
+    double longitude[2], double altitude[2], double * error)
+{
+        double * const range[3] = { latitude, longitude, altitude };
+        int i;
+        for (i = 0; i < 3; i++) {
+                if (range[i] == NULL) continue;
+                range[i][0] = grid->origin[i];
+                range[i][1] = grid->origin[i] + grid->cells[i] * grid->step[i];
+        }
+        if (error != NULL) *error = grid->error;
+}
+
+/*
+ * Data structure for evaluating the field along tracks, i.e. at closely spaced
+ * successive locations.
+ *
+ * The field is expanded to first order around an anchor location, using its
+ * gradient. The anchor is moved, i.e. the field and its gradient are computed
+ * anew, whenever the estimated error of the expansion exceeds the tolerance.
+ */
+struct gull_track {
+        /* The snapshot of the geomagnetic field. */
+        struct gull_snapshot * snapshot;
+        /* The tolerance on the expansion error, in T. */
+        double tolerance;
+        /* The geodetic coordinates of the anchor, in (deg, deg, m). */
+        double anchor[3];
+        /* The displacements along E and N, in m per deg. */
+        double metric[2];
+        /* The sine and cosine of the geodetic latitude of the anchor. */
+        double slat, clat;
+        /* The field and its gradient at the anchor, in T and T/m. */
+        double magnet[3];
+        double gradient[9];
+        /*
+         * The coefficients of the error estimate, for squared displacements,
+         * in T/m^2, and for squared rotations of the local frame, in T/rad^2.
+         */
+        double error[2];
+        /* Flag for a valid anchor. */
+        int anchored;
+        /* The number of evaluations, and of anchors. */
+        long n_steps, n_anchors;
+        /* The temporary workspace. */
+        double * workspace;
+};
+
+enum gull_return gull_track_create(struct gull_track ** track,
+    struct gull_snapshot * snapshot, double tolerance)
+{
+        GULL_ERROR_INITIALISE(gull_track_create);
+
+        *track = malloc(sizeof(**track));
+        if (*track == NULL) {
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        (*track)->workspace =
+            workspace_configure(workspace_size(snapshot->order), NULL);
+        if ((*track)->workspace == NULL) {
+                gull_track_destroy(track);
+                return GULL_ERROR_MESSAGE(
+                    GULL_RETURN_MEMORY_ERROR, "could not allocate memory");
+        }
+        (*track)->snapshot = snapshot;
+        (*track)->tolerance = tolerance;
+        (*track)->anchored = 0;
+        (*track)->n_steps = 0;
+        (*track)->n_anchors = 0;
+
+        return GULL_RETURN_SUCCESS;
+}
+
+void gull_track_destroy(struct gull_track ** track)
+{
+        if ((track == NULL) || (*track == NULL)) return;
+        free((*track)->workspace);
+        free(*track);
+        *track = NULL;
+}
+
+/*
+ * Move the anchor of a track to the given location. The altitude must be given
+ * in m.
+ *
+ * The second derivatives of the field are bounded per degree, from the power
+ * spectrum. The field of degree n is bounded by sqrt((2n + 1) W_n) (a / r)^(n
+ * + 2), where W_n is the Lowes-Mauersberger term, and each derivative adds a
+ * factor of at most (n + k + 1) / r. The first order expansion is also done in
+ * the local frame of the anchor, using a linearised displacement and rotation.
+ * The corresponding errors are quadratic as well, of the order of the gradient
+ * times d^2 / r and of the field times the rotation angle squared.
+ */
+static void track_anchor(struct gull_track * track, double latitude,
+    double longitude, double altitude)
+{
+        struct gull_snapshot * const snapshot = track->snapshot;
+        struct location location;
+        location_geodetic(latitude, longitude, altitude * 1E-03, &location);
+        gradient_kernel(snapshot, &location, track->workspace, track->magnet,
+            track->gradient);
+
+        track->anchor[0] = latitude;
+        track->anchor[1] = longitude;
+        track->anchor[2] = altitude;
+        track->anchored = 1;
+        track->n_anchors++;
+
+        /* Compute the radii of curvature of the ellipsoid. */
+        const double deg = M_PI / 180.;
+        const double a = sqrt(WGS84_A2) * 1E+03;
+        const double e2 = 1. - WGS84_B2 / WGS84_A2;
+        track->slat = sin(latitude * deg);
+        track->clat = cos(latitude * deg);
+        const double w = 1. - e2 * track->slat * track->slat;
+        const double rn = a / sqrt(w);
+        const double rm = a * (1. - e2) / (w * sqrt(w));
+        track->metric[0] = (rn + altitude) * track->clat * deg;
+        track->metric[1] = (rm + altitude) * deg;
+
+        /* Bound the second derivatives of the field. */
+        const double * const radial = workspace_radial(
+            track->workspace, snapshot->order, location.ratio);
+        const double * const spectrum = get_spectrum(snapshot);
+        double d2 = 0.;
+        int n;
+        for (n = 1; n <= snapshot->order; n++) {
+                d2 += (n + 2.) * (n + 3.) * sqrt((2. * n + 1.) *
+                    spectrum[n - 1]) * radial[n - 1];
+        }
+        const double r = EARTHS_RADIUS * 1E+03 / location.ratio;
+        d2 *= 1E-09 / (r * r);
+
+        double g2 = 0., b2 = 0.;
+        int i;
+        for (i = 0; i < 9; i++) g2 += track->gradient[i] * track->gradient[i];
+        for (i = 0; i < 3; i++) b2 += track->magnet[i] * track->magnet[i];
+        track->error[0] = 0.5 * d2 + sqrt(g2) / r;
+        track->error[1] = sqrt(b2);
+}
+
+enum gull_return gull_track_field(struct gull_track * track, double latitude,
+    double longitude, double altitude, double magnet[3])
+{
+        GULL_ERROR_INITIALISE(gull_track_field);
+        struct gull_snapshot * const snapshot = track->snapshot;
+
+        /* Check the altitude. */
+        const double z = altitude * 1E-03; /* m -> km. */
+        if ((z < snapshot->altmin) || (z > snapshot->altmax)) {
+                STATS_ADD(domain_points, 1);
+                GULL_ERROR_FORMAT(GULL_RETURN_DOMAIN_ERROR,
+                    "invalid altitude value: %.5lE", z);
+        }
+        track->n_steps++;
+
+        /* Get the displacement from the anchor, in its local frame. */
+        double dlat = 0., dlon = 0., dx[3] = { 0., 0., 0. };
+        double error = track->tolerance;
+        if (track->anchored) {
+                dlat = latitude - track->anchor[0];
+                dlon = longitude - track->anchor[1];
+                if ((dlon < -180.) || (dlon >= 180.))
+                        dlon -= 360. * floor((dlon + 180.) / 360.);
+                dx[0] = track->metric[0] * dlon;
+                dx[1] = track->metric[1] * dlat;
+                dx[2] = altitude - track->anchor[2];
+
+                /* Estimate the error of the first order expansion. */
+                const double deg = M_PI / 180.;
+                dlat *= deg;
+                dlon *= deg;
+                error = track->error[0] *
+                        (dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2]) +
+                    track->error[1] * (dlat * dlat + dlon * dlon);
+        }
+
+        /* Move the anchor if needed. */
+        if (!(error < track->tolerance)) {
+                track_anchor(track, latitude, longitude, altitude);
+                memcpy(magnet, track->magnet, 3 * sizeof(*magnet));
+                return GULL_RETURN_SUCCESS;
+        }
+
+        /* Expand the field to first order, in the frame of the anchor. */
+        const double * const g = track->gradient;
+        double b[3];
+        int i;
+        for (i = 0; i < 3; i++) {
+                b[i] = track->magnet[i] + g[3 * i] * dx[0] +
+                    g[3 * i + 1] * dx[1] + g[3 * i + 2] * dx[2];
+        }
+
+        /*
+         * Rotate to the local frame, i.e. by *dlon* around the Earth axis and
+         * by *dlat* around the East axis.
+         */
+        const double s = track->slat, c = track->clat;
+        magnet[0] = b[0] + dlon * (s * b[1] - c * b[2]);
+        magnet[1] = b[1] - dlon * s * b[0] - dlat * b[2];
+        magnet[2] = b[2] + dlon * c * b[0] + dlat * b[1];
+
+        return GULL_RETURN_SUCCESS;
+}
+
+void gull_track_reset(struct gull_track * track) { track->anchored = 0; }
+
+/* Information on a track. */
+void gull_track_info(struct gull_track * track, double * tolerance,
+    long * n_steps, long * n_anchors)
+{
+        if (tolerance != NULL) *tolerance = track->tolerance;
+        if (n_steps != NULL) *n_steps = track->n_steps;
+        if (n_anchors != NULL) *n_anchors = track->n_anchors;
 }
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Benchmark the hot paths of the GULL library. The cost of each path is
+ * reported per call, or per point for batch evaluations, as the best of
+ * several runs. If OpenMP is enabled, the scaling of batch evaluations with
+ * the number of threads is reported as well.
+ */
+
+/* For clock_gettime. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "gull.h"
+/* C89 standard library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+/* OpenMP */
+#include <omp.h>
+#endif
+
+/* The number of points of batch benchmarks. */
+#define N_POINTS 4096
+/* The minimum duration of a run, in seconds. */
+#define MIN_DURATION 0.05
+/* The number of runs per benchmark. */
+#define N_RUNS 5
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        fprintf(stderr, "gull-bench: %s\n", message);
+        exit(EXIT_FAILURE);
+}
+
+/* The benchmark context, shared by all benchmarks. */
+static struct {
+        const char * path[2];
+        struct gull_snapshot * snapshot;
+        struct gull_model * model;
+        struct gull_grid * grid;
+        struct gull_track * track;
+        double * workspace;
+        double date[N_POINTS];
+        double latitude[N_POINTS];
+        double longitude[N_POINTS];
+        double altitude[N_POINTS];
+        double field[3 * N_POINTS];
+        float field_float[3 * N_POINTS];
+} context;
+
+/* Wall clock time, in seconds. */
+static double clock_now(void)
+{
+#ifdef _OPENMP
+        return omp_get_wtime();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1E-09 * ts.tv_nsec;
+#endif
+}
+
+/* A benchmark, running *n* iterations and returning the number of points. */
+typedef int bench_t(int n);
+
+/*
+ * Measure the cost of a benchmark, in ns per point. The number of iterations
+ * is increased until a run lasts at least MIN_DURATION. Then, the best of
+ * N_RUNS runs is returned.
+ */
+static double bench_measure(bench_t * bench)
+{
+        int n = 1, points = 0;
+        double dt = 0.;
+        for (;;) {
+                const double t0 = clock_now();
+                points = bench(n);
+                dt = clock_now() - t0;
+                if (dt >= MIN_DURATION) break;
+                n *= 2;
+        }
+
+        double best = dt / points;
+        int i;
+        for (i = 1; i < N_RUNS; i++) {
+                const double t0 = clock_now();
+                points = bench(n);
+                dt = (clock_now() - t0) / points;
+                if (dt < best) best = dt;
+        }
+        return best * 1E+09;
+}
+
+static void bench_report(const char * name, bench_t * bench)
+{
+        printf("%-40s %10.1f ns\n", name, bench_measure(bench));
+        fflush(stdout);
+}
+
+static int bench_create_igrf(int n)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                struct gull_snapshot * snapshot = NULL;
+                gull_snapshot_create(&snapshot, context.path[0], 1, 1, 2020);
+                gull_snapshot_destroy(&snapshot);
+        }
+        return n;
+}
+
+static int bench_create_wmm(int n)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                struct gull_snapshot * snapshot = NULL;
+                gull_snapshot_create(&snapshot, context.path[1], 1, 1, 2020);
+                gull_snapshot_destroy(&snapshot);
+        }
+        return n;
+}
+
+static int bench_field_null(int n)
+{
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field(context.snapshot,
+                            context.latitude[j], context.longitude[j],
+                            context.altitude[j], context.field, NULL);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_reused(int n)
+{
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field(context.snapshot,
+                            context.latitude[j], context.longitude[j],
+                            context.altitude[j], context.field,
+                            &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_parallel(int n)
+{
+        /* Scan along a parallel, i.e. with cached radial factors. */
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field(context.snapshot, 45.,
+                            context.longitude[j], 1E+03, context.field,
+                            &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_v(int n)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                gull_snapshot_field_v(context.snapshot, N_POINTS,
+                    context.latitude, context.longitude, context.altitude,
+                    context.field, &context.workspace);
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_float(int n)
+{
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field_float(context.snapshot,
+                            context.latitude[j], context.longitude[j],
+                            context.altitude[j], context.field_float,
+                            &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_float_v(int n)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                gull_snapshot_field_float_v(context.snapshot, N_POINTS,
+                    context.latitude, context.longitude, context.altitude,
+                    context.field_float, &context.workspace);
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_ecef(int n)
+{
+        const double position[3] = { 4.2E+06, 1.7E+05, 4.8E+06 };
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field_ecef(context.snapshot, position,
+                            context.field, &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_gradient(int n)
+{
+        double gradient[9];
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field_gradient(context.snapshot,
+                            context.latitude[j], context.longitude[j],
+                            context.altitude[j], context.field, gradient,
+                            &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_field_truncated(int n)
+{
+        /* At 500 km, with a 10 nT tolerance. */
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_snapshot_field_truncated(context.snapshot,
+                            context.latitude[j], context.longitude[j], 5E+05,
+                            0, 1E-08, context.field, NULL, &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_grid_field(int n)
+{
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_grid_field(context.grid, context.latitude[j],
+                            context.longitude[j], context.altitude[j],
+                            context.field);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_track_field(int n)
+{
+        /* Step by about 1 m along a straight track. */
+        int i, j;
+        for (i = 0; i < n; i++) {
+                gull_track_reset(context.track);
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_track_field(context.track, 45. + 1E-05 * j,
+                            3. + 1E-05 * j, 1E+03 + 0.5 * j, context.field);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_model_field(int n)
+{
+        int i, j;
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < N_POINTS; j++) {
+                        gull_model_field(context.model, context.date[j],
+                            context.latitude[j], context.longitude[j],
+                            context.altitude[j], context.field,
+                            &context.workspace);
+                }
+        }
+        return n * N_POINTS;
+}
+
+static int bench_model_field_v(int n)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                gull_model_field_v(context.model, N_POINTS, context.date,
+                    context.latitude, context.longitude, context.altitude,
+                    context.field, &context.workspace);
+        }
+        return n * N_POINTS;
+}
+
+#ifdef _OPENMP
+static int bench_field_v_threads(int n)
+{
+        /* Each thread evaluates its own batches, with its own workspace. */
+#pragma omp parallel
+        {
+                double * workspace = NULL;
+                double * field = malloc(3 * N_POINTS * sizeof(*field));
+                if (field == NULL) {
+                        fprintf(stderr,
+                            "gull-bench: could not allocate memory\n");
+                        exit(EXIT_FAILURE);
+                }
+                const int m = n * omp_get_num_threads();
+                int i;
+#pragma omp for schedule(static)
+                for (i = 0; i < m; i++) {
+                        gull_snapshot_field_v(context.snapshot, N_POINTS,
+                            context.latitude, context.longitude,
+                            context.altitude, field, &workspace);
+                }
+                free(field);
+                free(workspace);
+        }
+        return n * omp_get_max_threads() * N_POINTS;
+}
+
+static int bench_field_map_threads(int n)
+{
+        const double latitude[2] = { -90., 90. };
+        const double longitude[2] = { -180., 180. };
+        const int n_latitude = 64, n_longitude = N_POINTS / n_latitude;
+        int i;
+        for (i = 0; i < n; i++) {
+                gull_snapshot_field_map(context.snapshot, 1E+03, latitude,
+                    n_latitude, longitude, n_longitude, 0, n_latitude,
+                    context.field);
+        }
+        return n * N_POINTS;
+}
+#endif
+
+int main(int argc, char * argv[])
+{
+        if (argc > 2) {
+                fprintf(stderr, "usage: gull-bench [DATA_DIR]\n");
+                exit(EXIT_FAILURE);
+        }
+        gull_error_handler_set(&handle_error);
+
+        /* Initialise the context. */
+        const char * directory = (argc > 1) ? argv[1] : "share/data";
+        static char path[2][1024];
+        const char * name[2] = { "IGRF13.COF", "WMM2020.COF" };
+        int i;
+        for (i = 0; i < 2; i++) {
+                const int n = snprintf(path[i], sizeof(path[i]), "%s/%s",
+                    directory, name[i]);
+                if ((n < 0) || (n >= (int)sizeof(path[i]))) {
+                        fprintf(stderr, "gull-bench: path is too long\n");
+                        exit(EXIT_FAILURE);
+                }
+                context.path[i] = path[i];
+        }
+
+        srand(20200101);
+        for (i = 0; i < N_POINTS; i++) {
+                const double u = rand() / (RAND_MAX + 1.);
+                const double v = rand() / (RAND_MAX + 1.);
+                const double w = rand() / (RAND_MAX + 1.);
+                context.latitude[i] = -90. + 180. * u;
+                context.longitude[i] = -180. + 360. * v;
+                context.altitude[i] = 1E+04 * w;
+                context.date[i] = 2020. + 4.9 * i / N_POINTS;
+        }
+
+        gull_snapshot_create(&context.snapshot, context.path[0], 1, 1, 2020);
+        gull_model_create(&context.model, context.path[0]);
+
+        /* Run the benchmarks. */
+        printf("# Snapshot creation (per call)\n");
+        bench_report("gull_snapshot_create (IGRF13)", &bench_create_igrf);
+        bench_report("gull_snapshot_create (WMM2020)", &bench_create_wmm);
+
+        printf("# Snapshot field, IGRF13 (per point)\n");
+        bench_report("gull_snapshot_field (NULL workspace)", &bench_field_null);
+        bench_report(
+            "gull_snapshot_field (reused workspace)", &bench_field_reused);
+        bench_report(
+            "gull_snapshot_field (along a parallel)", &bench_field_parallel);
+        bench_report("gull_snapshot_field_v", &bench_field_v);
+        bench_report("gull_snapshot_field_float", &bench_field_float);
+        bench_report("gull_snapshot_field_float_v", &bench_field_float_v);
+        bench_report("gull_snapshot_field_ecef", &bench_field_ecef);
+        bench_report("gull_snapshot_field_gradient", &bench_field_gradient);
+        bench_report(
+            "gull_snapshot_field_truncated (500 km)", &bench_field_truncated);
+
+        printf("# Grid lookup, IGRF13 (per point)\n");
+        const double latitude[2] = { -90., 90. };
+        const double longitude[2] = { -180., 180. };
+        const double altitude[2] = { 0., 1E+04 };
+        const double resolution[3] = { 1., 1., 1E+03 };
+        gull_grid_create(&context.grid, context.snapshot, latitude, longitude,
+            altitude, resolution, 0.);
+        bench_report(
+            "gull_grid_field (1 deg x 1 deg x 1 km)", &bench_grid_field);
+        gull_grid_destroy(&context.grid);
+
+        printf("# Track, IGRF13 (per point)\n");
+        gull_track_create(&context.track, context.snapshot, 1E-09);
+        bench_report("gull_track_field (1 nT, 1 m steps)", &bench_track_field);
+        gull_track_destroy(&context.track);
+
+        printf("# Model field, IGRF13 (per point)\n");
+        bench_report("gull_model_field", &bench_model_field);
+        bench_report("gull_model_field_v", &bench_model_field_v);
+
+#ifdef _OPENMP
+        printf("# Thread scaling, IGRF13 (per point)\n");
+        const int max_threads = omp_get_max_threads();
+        int n_threads;
+        for (n_threads = 1;; n_threads *= 2) {
+                if (n_threads > max_threads) n_threads = max_threads;
+                omp_set_num_threads(n_threads);
+                char label[64];
+                sprintf(label, "gull_snapshot_field_v (%d threads)", n_threads);
+                bench_report(label, &bench_field_v_threads);
+                sprintf(label, "gull_snapshot_field_map (%d threads)",
+                    n_threads);
+                bench_report(label, &bench_field_map_threads);
+                if (n_threads == max_threads) break;
+        }
+#endif
+
+        /* Finalise and exit to the OS. */
+        free(context.workspace);
+        gull_model_destroy(&context.model);
+        gull_snapshot_destroy(&context.snapshot);
+        exit(EXIT_SUCCESS);
+}
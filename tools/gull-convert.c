@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Convert a geomagnetic model data file, e.g. in COF format, to GULL's
+ * compact binary format.
+ */
+
+#include "gull.h"
+/* C89 standard library */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        fprintf(stderr, "gull-convert: %s\n", message);
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char * argv[])
+{
+        if (argc != 3) {
+                fprintf(stderr, "usage: gull-convert INPUT OUTPUT\n");
+                exit(EXIT_FAILURE);
+        }
+        gull_error_handler_set(&handle_error);
+
+        struct gull_model * model;
+        gull_model_create(&model, argv[1]);
+        gull_model_dump(model, argv[2]);
+        gull_model_destroy(&model);
+
+        exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Generate C tables of builtin geomagnetic models, from data files. This is a
+ * build tool, used when compiling the library with EMBED_MODELS=1. The models
+ * are converted to GULL's binary format, which is then written out as an
+ * array of doubles, using exact hexadecimal literals. Thus, the coefficients
+ * are accessed through their actual type when the model is loaded. Note that
+ * the header words are written as doubles as well, and read back as bytes.
+ */
+
+#include "gull.h"
+/* C89 standard library */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        fprintf(stderr, "gull-embed: %s\n", message);
+        exit(EXIT_FAILURE);
+}
+
+/* Dump a fatal error and exit to the OS. */
+static void fatal(const char * message, const char * argument)
+{
+        fprintf(stderr, "gull-embed: %s `%s`\n", message, argument);
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char * argv[])
+{
+        if (argc < 3) {
+                fprintf(stderr, "usage: gull-embed OUTPUT NAME=PATH...\n");
+                exit(EXIT_FAILURE);
+        }
+        gull_error_handler_set(&handle_error);
+
+        const char * output = argv[1];
+        char tmp[1024];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", output);
+        FILE * out = fopen(output, "w");
+        if (out == NULL) fatal("could not open file", output);
+        fprintf(out, "/* Generated by gull-embed. Do not edit. */\n");
+
+        /* Dump the data of each model. */
+        int i;
+        for (i = 2; i < argc; i++) {
+                char name[64];
+                const char * path = strchr(argv[i], '=');
+                if ((path == NULL) || (path - argv[i] >= (long)sizeof(name)))
+                        fatal("invalid argument", argv[i]);
+                memcpy(name, argv[i], path - argv[i]);
+                name[path - argv[i]] = '\0';
+                path++;
+
+                /* Convert the model to binary. */
+                struct gull_model * model;
+                gull_model_create(&model, path);
+                gull_model_dump(model, tmp);
+                gull_model_destroy(&model);
+
+                /*
+                 * Write the binary data as doubles. Non finite words have no
+                 * exact literal, e.g. NaN payloads, thus they are rejected.
+                 */
+                FILE * fid = fopen(tmp, "rb");
+                if (fid == NULL) fatal("could not open file", tmp);
+                fprintf(out, "\nstatic const double builtin_%s[] = {", name);
+                double word;
+                int n;
+                for (n = 0; fread(&word, sizeof(word), 1, fid) == 1; n++) {
+                        if (!isfinite(word))
+                                fatal("non finite data in model", path);
+                        fprintf(out, "%s%a,", (n % 2) ? " " : "\n        ",
+                            word);
+                }
+                fprintf(out, "\n};\n");
+                fclose(fid);
+                remove(tmp);
+        }
+
+        /* Write the table of models. */
+        fprintf(out, "\nstatic const struct builtin_model builtin_models[] = {");
+        for (i = 2; i < argc; i++) {
+                const int n = (int)(strchr(argv[i], '=') - argv[i]);
+                fprintf(out, "\n        { \"%.*s\", builtin_%.*s, "
+                             "sizeof(builtin_%.*s) },",
+                    n, argv[i], n, argv[i], n, argv[i]);
+        }
+        fprintf(out, "\n};\n");
+        fclose(out);
+
+        exit(EXIT_SUCCESS);
+}
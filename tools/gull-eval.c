@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Evaluate the geomagnetic field for a stream of records, e.g. read from the
+ * standard input, and write the field components to another stream.
+ *
+ * Input records are (date, latitude, longitude, altitude), with the date as a
+ * decimal year, the latitude and the longitude in deg, and the altitude in m.
+ * If a fixed date is provided, the records are (latitude, longitude,
+ * altitude) instead. Text records are one per line, with values separated by
+ * blanks or commas. Blank lines and lines starting with a `#` are skipped.
+ * Binary records are native doubles. Output records are the E, N, U
+ * components of the field, in T, as a line of text or as 3 native doubles.
+ *
+ * The input is processed by chunks, which are split between worker threads.
+ * Each worker parses its part of the chunk, evaluates the field with the batch
+ * API, reusing its workspace, and formats the result. Meanwhile, the main
+ * thread writes the output of the previous chunk and reads the next chunk,
+ * i.e. the I/O is double-buffered.
+ *
+ * Records outside of the validity domain of the model, e.g. with an invalid
+ * altitude or date, do not stop the evaluation. Their field components are
+ * set to NaN, and they are reported once all records have been processed.
+ * Workers run without error handler, and only the main thread exits on
+ * errors.
+ */
+
+/* For POSIX threads and sysconf. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "gull.h"
+/* C89 standard library */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <pthread.h>
+#include <unistd.h>
+
+/* The size of input chunks, in bytes. */
+#define CHUNK_SIZE (1 << 24)
+/* The number of records per call to the batch API. */
+#define BATCH_SIZE 1024
+/* The maximum length of a text output record. */
+#define RECORD_LENGTH 64
+/* The maximum number of worker threads. */
+#define MAX_THREADS 256
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        fprintf(stderr, "gull-eval: %s\n", message);
+        exit(EXIT_FAILURE);
+}
+
+/* Dump an error message and exit to the OS. */
+static void exit_with_error(const char * message, const char * argument)
+{
+        fprintf(stderr, "gull-eval: ");
+        fprintf(stderr, message, argument);
+        fprintf(stderr, "\n");
+        exit(EXIT_FAILURE);
+}
+
+static void exit_with_usage(void)
+{
+        fprintf(stderr,
+            "usage: gull-eval [OPTIONS] MODEL [INPUT [OUTPUT]]\n"
+            "\n"
+            "Evaluate the geomagnetic field of MODEL for the records of INPUT,\n"
+            "and write the E, N, U components to OUTPUT. Records are given as\n"
+            "(date, latitude, longitude, altitude), in decimal year, deg, deg\n"
+            "and m. INPUT and OUTPUT default to the standard streams, which\n"
+            "can also be selected with `-`.\n"
+            "\n"
+            "Options:\n"
+            "  -b, --binary          read and write native doubles, instead\n"
+            "                        of text\n"
+            "  -d, --date=Y          evaluate all records at date Y, given\n"
+            "                        as a decimal year. Records are then\n"
+            "                        (latitude, longitude, altitude).\n"
+            "  -t, --threads=N       number of worker threads [all CPUs]\n");
+        exit(EXIT_FAILURE);
+}
+
+/* Get the value of an option, either as attached or as the next argument. */
+static const char * option_value(int argc, char * argv[], int * i,
+    const char * short_name, const char * long_name)
+{
+        const char * arg = argv[*i];
+        const size_t n = strlen(long_name);
+        if ((short_name != NULL) && (strcmp(arg, short_name) == 0)) {
+                if (*i + 1 >= argc) exit_with_usage();
+                return argv[++(*i)];
+        } else if (strncmp(arg, long_name, n) == 0) {
+                if (arg[n] == '=') return arg + n + 1;
+                if (arg[n] != '\0') return NULL;
+                if (*i + 1 >= argc) exit_with_usage();
+                return argv[++(*i)];
+        }
+        return NULL;
+}
+
+/* Parse a floating point value. */
+static double parse_value(const char * arg)
+{
+        char * end;
+        const double value = strtod(arg, &end);
+        if ((end == arg) || (*end != '\0')) exit_with_usage();
+        return value;
+}
+
+/* The evaluation settings, shared by all workers. */
+static struct {
+        /* Flag for binary records. */
+        int binary;
+        /* The number of values per input record. */
+        int n_values;
+        /* The geomagnetic model, for records with a date. */
+        struct gull_model * model;
+        /* The snapshot of the geomagnetic model, for a fixed date. */
+        struct gull_snapshot * snapshot;
+} settings;
+
+/* The state of a worker thread, reused for all chunks. */
+struct worker {
+        /* The workspace of the batch API. */
+        double * workspace;
+        /* The records of the current batch, as separate arrays. */
+        double date[BATCH_SIZE];
+        double latitude[BATCH_SIZE];
+        double longitude[BATCH_SIZE];
+        double altitude[BATCH_SIZE];
+        double field[3 * BATCH_SIZE];
+        /* The validity flags of the records, as a bitmask. */
+        unsigned char valid[(BATCH_SIZE + 7) / 8];
+        /* The index of the records in their part, i.e. a line or a record. */
+        long index[BATCH_SIZE];
+};
+
+/* A part of a chunk, processed by a single worker. */
+struct part {
+        /* The worker processing this part. */
+        struct worker * worker;
+        pthread_t thread;
+        /* The input data. */
+        const char * input;
+        size_t input_size;
+        /* The output data. */
+        char * output;
+        size_t output_size;
+        size_t output_capacity;
+        /* The number of text lines, and the first invalid one, if any. */
+        long n_lines;
+        const char * error;
+        /* Flag for memory errors. */
+        int failed;
+        /* The number of records out of the model domain, and the first one. */
+        long n_invalid;
+        long first_invalid;
+};
+
+/* A chunk of input records, and the corresponding output. */
+struct chunk {
+        /* The input data, null terminated for parsing text. */
+        char * data;
+        size_t size;
+        /* The parts processed by each worker. */
+        int n_parts;
+        struct part part[MAX_THREADS];
+};
+
+/*
+ * Reserve space for *size* more bytes in the output of a part. On failure, the
+ * part is flagged and 0 is returned.
+ */
+static int part_reserve(struct part * part, size_t size)
+{
+        if (part->output_size + size <= part->output_capacity) return 1;
+        const size_t capacity = 2 * (part->output_size + size);
+        char * output = realloc(part->output, capacity);
+        if (output == NULL) {
+                part->failed = 1;
+                return 0;
+        }
+        part->output = output;
+        part->output_capacity = capacity;
+        return 1;
+}
+
+/*
+ * Evaluate the field for the current batch of records of a worker. Records out
+ * of the model domain are set to NaN, and counted in *part*. On a memory
+ * error, the part is flagged and 0 is returned.
+ */
+static int worker_evaluate(struct worker * worker, int n, struct part * part)
+{
+        enum gull_return rc;
+        int i;
+        if (settings.snapshot != NULL) {
+                rc = gull_snapshot_field_checked(settings.snapshot, n,
+                    worker->latitude, worker->longitude, worker->altitude,
+                    GULL_DOMAIN_NAN, worker->field, worker->valid,
+                    &worker->workspace);
+        } else {
+                rc = gull_model_field_v(settings.model, n, worker->date,
+                    worker->latitude, worker->longitude, worker->altitude,
+                    worker->field, &worker->workspace);
+                memset(worker->valid, 0xFF, sizeof(worker->valid));
+                if ((rc == GULL_RETURN_DOMAIN_ERROR) ||
+                    (rc == GULL_RETURN_MISSING_DATA)) {
+                        /* Locate the invalid records, one by one. */
+                        for (i = 0; i < n; i++) {
+                                rc = gull_model_field_v(settings.model, 1,
+                                    worker->date + i, worker->latitude + i,
+                                    worker->longitude + i,
+                                    worker->altitude + i,
+                                    worker->field + 3 * i, &worker->workspace);
+                                if (rc == GULL_RETURN_MEMORY_ERROR) break;
+                                if (rc == GULL_RETURN_SUCCESS) continue;
+                                worker->valid[i / 8] &= ~(1U << (i % 8));
+                                double * const f = worker->field + 3 * i;
+                                f[0] = f[1] = f[2] = NAN;
+                        }
+                        if (i == n) rc = GULL_RETURN_SUCCESS;
+                }
+        }
+        if (rc != GULL_RETURN_SUCCESS) {
+                part->failed = 1;
+                return 0;
+        }
+
+        for (i = 0; i < n; i++) {
+                if (worker->valid[i / 8] & (1U << (i % 8))) continue;
+                if (part->n_invalid++ == 0)
+                        part->first_invalid = worker->index[i];
+        }
+        return 1;
+}
+
+/* Load a record in the current batch of a worker. */
+static void worker_load(struct worker * worker, int i, const double * values)
+{
+        const int k = settings.n_values - 3;
+        worker->date[i] = (k > 0) ? values[0] : 0.;
+        worker->latitude[i] = values[k];
+        worker->longitude[i] = values[k + 1];
+        worker->altitude[i] = values[k + 2];
+}
+
+/* Process a part of binary records. */
+static void part_process_binary(struct part * part)
+{
+        struct worker * const worker = part->worker;
+        const size_t record_size = settings.n_values * sizeof(double);
+        const size_t n_records = part->input_size / record_size;
+        part->n_lines = n_records;
+        if (!part_reserve(part, 3 * n_records * sizeof(double))) return;
+
+        size_t i;
+        for (i = 0; i < n_records; i += BATCH_SIZE) {
+                const int n = (i + BATCH_SIZE <= n_records) ?
+                    BATCH_SIZE :
+                    (int)(n_records - i);
+                int j;
+                for (j = 0; j < n; j++) {
+                        double values[4];
+                        memcpy(values, part->input + (i + j) * record_size,
+                            record_size);
+                        worker_load(worker, j, values);
+                        worker->index[j] = i + j;
+                }
+                if (!worker_evaluate(worker, n, part)) return;
+                memcpy(part->output + part->output_size, worker->field,
+                    3 * n * sizeof(double));
+                part->output_size += 3 * n * sizeof(double);
+        }
+}
+
+/* Check if a character separates values of a text record. */
+static int is_separator(char c)
+{
+        return (c == ' ') || (c == '\t') || (c == ',') || (c == '\r');
+}
+
+/*
+ * Parse a line of text, ending before *end*. The number of parsed values is
+ * returned, i.e. 0 for a line to skip or -1 for an invalid line. The line
+ * pointer is moved to the next line.
+ */
+static int parse_line(const char ** line, const char * end, double * values)
+{
+        const char * s = *line;
+        while ((s < end) && is_separator(*s)) s++;
+        int n = 0;
+        if ((s < end) && (*s != '#') && (*s != '\n')) {
+                for (n = 0; n < settings.n_values; n++) {
+                        char * tail;
+                        values[n] = strtod(s, &tail);
+                        if ((tail == s) || ((tail < end) &&
+                                               !is_separator(*tail) &&
+                                               (*tail != '\n')))
+                                return -1;
+                        s = tail;
+                        while ((s < end) && is_separator(*s)) s++;
+                }
+                if ((s < end) && (*s != '\n')) return -1;
+        }
+
+        /* Move to the next line. */
+        const char * next = (s < end) ? memchr(s, '\n', end - s) : NULL;
+        *line = (next == NULL) ? end : next + 1;
+        return n;
+}
+
+/* Process a part of text records. */
+static void part_process_text(struct part * part)
+{
+        struct worker * const worker = part->worker;
+        const char * s = part->input;
+        const char * const end = s + part->input_size;
+        while (s < end) {
+                /* Parse a batch of records. */
+                int n = 0;
+                while ((n < BATCH_SIZE) && (s < end)) {
+                        const char * const line = s;
+                        double values[4];
+                        const int rc = parse_line(&s, end, values);
+                        part->n_lines++;
+                        if (rc < 0) {
+                                part->error = line;
+                                return;
+                        } else if (rc > 0) {
+                                worker->index[n] = part->n_lines - 1;
+                                worker_load(worker, n++, values);
+                        }
+                }
+                if (n == 0) break;
+
+                /* Evaluate and format. */
+                if (!worker_evaluate(worker, n, part) ||
+                    !part_reserve(part, (size_t)n * RECORD_LENGTH))
+                        return;
+                int i;
+                for (i = 0; i < n; i++) {
+                        const double * const f = worker->field + 3 * i;
+                        part->output_size +=
+                            sprintf(part->output + part->output_size,
+                                "%.6e %.6e %.6e\n", f[0], f[1], f[2]);
+                }
+        }
+}
+
+/* Entry point of worker threads. */
+static void * part_process(void * arg)
+{
+        struct part * const part = arg;
+        part->output_size = 0;
+        part->n_lines = 0;
+        part->error = NULL;
+        part->failed = 0;
+        part->n_invalid = 0;
+        part->first_invalid = -1;
+        if (settings.binary)
+                part_process_binary(part);
+        else
+                part_process_text(part);
+        return NULL;
+}
+
+/* Split a chunk between workers, and start processing it. */
+static void chunk_start(struct chunk * chunk, int n_workers,
+    struct worker * workers)
+{
+        const size_t record_size = settings.n_values * sizeof(double);
+        size_t offset = 0;
+        int i;
+        for (i = 0; (i < n_workers) && (offset < chunk->size); i++) {
+                /* Locate the end of this part, on a record boundary. */
+                size_t stop = (chunk->size / n_workers) * (i + 1);
+                if ((i == n_workers - 1) || (stop >= chunk->size)) {
+                        stop = chunk->size;
+                } else if (settings.binary) {
+                        stop -= stop % record_size;
+                } else {
+                        const char * const next =
+                            memchr(chunk->data + stop, '\n',
+                                chunk->size - stop);
+                        stop = (next == NULL) ? chunk->size :
+                                                next - chunk->data + 1;
+                }
+                if (stop <= offset) continue;
+
+                struct part * const part = chunk->part + chunk->n_parts++;
+                part->worker = workers + i;
+                part->input = chunk->data + offset;
+                part->input_size = stop - offset;
+                if (pthread_create(&part->thread, NULL, &part_process, part) !=
+                    0)
+                        exit_with_error("could not create thread", NULL);
+                offset = stop;
+        }
+}
+
+/*
+ * Record of the records out of the model domain, i.e. their number and the
+ * first one, as a line or as a record index.
+ */
+static long _n_invalid = 0;
+static long _first_invalid = -1;
+
+/* Wait for the workers of a chunk, and check for invalid records. */
+static void chunk_wait(struct chunk * chunk, long * line, const char * path)
+{
+        int i;
+        for (i = 0; i < chunk->n_parts; i++)
+                pthread_join(chunk->part[i].thread, NULL);
+
+        for (i = 0; i < chunk->n_parts; i++) {
+                const struct part * const part = chunk->part + i;
+                if (part->failed)
+                        exit_with_error("could not allocate memory", NULL);
+                if ((part->n_invalid > 0) && (_n_invalid == 0))
+                        _first_invalid = *line + part->first_invalid + 1;
+                _n_invalid += part->n_invalid;
+                *line += part->n_lines;
+                if (part->error != NULL) {
+                        fprintf(stderr, "gull-eval: invalid record [%s:%ld]\n",
+                            path, *line);
+                        exit(EXIT_FAILURE);
+                }
+        }
+}
+
+/* Write the output of a chunk. */
+static void chunk_write(struct chunk * chunk, FILE * stream, const char * path)
+{
+        int i;
+        for (i = 0; i < chunk->n_parts; i++) {
+                const struct part * const part = chunk->part + i;
+                if (fwrite(part->output, 1, part->output_size, stream) !=
+                    part->output_size)
+                        exit_with_error("could not write `%s`", path);
+        }
+        chunk->n_parts = 0;
+}
+
+/*
+ * Read the next chunk. The chunk stops on a record boundary. The remaining
+ * bytes are carried over to the next read. The size of the chunk is returned,
+ * i.e. 0 at the end of the stream.
+ */
+static size_t chunk_read(struct chunk * chunk, char * carry,
+    size_t * carry_size, FILE * stream, const char * path)
+{
+        memcpy(chunk->data, carry, *carry_size);
+        const size_t n = *carry_size +
+            fread(chunk->data + *carry_size, 1, CHUNK_SIZE - *carry_size,
+                stream);
+        if (ferror(stream)) exit_with_error("could not read `%s`", path);
+        const int eof = (n < CHUNK_SIZE);
+
+        size_t size;
+        if (settings.binary) {
+                const size_t record_size = settings.n_values * sizeof(double);
+                size = n - n % record_size;
+                if (eof && (size < n))
+                        exit_with_error("truncated record in `%s`", path);
+        } else if (eof) {
+                size = n;
+        } else {
+                size = n;
+                while ((size > 0) && (chunk->data[size - 1] != '\n')) size--;
+                if (size == 0) exit_with_error("record too long in `%s`", path);
+        }
+        *carry_size = n - size;
+        memcpy(carry, chunk->data + size, *carry_size);
+        chunk->data[size] = '\0';
+        chunk->size = size;
+        return size;
+}
+
+int main(int argc, char * argv[])
+{
+        /* Parse the command line. */
+        const char * positional[3] = { NULL, "-", "-" };
+        double date = 0.;
+        int fixed_date = 0, n_workers = 0;
+        int i, n_positional = 0;
+        for (i = 1; i < argc; i++) {
+                const char * value;
+                if ((strcmp(argv[i], "-b") == 0) ||
+                    (strcmp(argv[i], "--binary") == 0)) {
+                        settings.binary = 1;
+                } else if ((value = option_value(
+                                argc, argv, &i, "-d", "--date")) != NULL) {
+                        date = parse_value(value);
+                        fixed_date = 1;
+                } else if ((value = option_value(argc, argv, &i, "-t",
+                                "--threads")) != NULL) {
+                        const double n = parse_value(value);
+                        if (!((n >= 1.) && (n <= MAX_THREADS)))
+                                exit_with_usage();
+                        n_workers = (int)n;
+                } else if ((argv[i][0] == '-') && (argv[i][1] != '\0')) {
+                        exit_with_usage();
+                } else {
+                        if (n_positional >= 3) exit_with_usage();
+                        positional[n_positional++] = argv[i];
+                }
+        }
+        if (n_positional < 1) exit_with_usage();
+        if (n_workers == 0) {
+                const long n = sysconf(_SC_NPROCESSORS_ONLN);
+                n_workers = (n < 1) ? 1 : (n > MAX_THREADS) ? MAX_THREADS : n;
+        }
+        settings.n_values = fixed_date ? 3 : 4;
+
+        /* Load the geomagnetic model. */
+        gull_error_handler_set(&handle_error);
+        gull_model_create(&settings.model, positional[0]);
+        if (fixed_date) {
+                gull_model_snapshot(settings.model, date, &settings.snapshot);
+                gull_model_destroy(&settings.model);
+        }
+
+        /*
+         * Errors of the workers are checked from return codes, thus the error
+         * handler is removed.
+         */
+        gull_error_handler_set(NULL);
+
+        /* Open the streams. */
+        const char * const input = positional[1];
+        const char * const output = positional[2];
+        FILE * fin = stdin, * fout = stdout;
+        if ((strcmp(input, "-") != 0) && ((fin = fopen(input, "rb")) == NULL))
+                exit_with_error("could not open `%s`", input);
+        if ((strcmp(output, "-") != 0) &&
+            ((fout = fopen(output, "wb")) == NULL))
+                exit_with_error("could not open `%s`", output);
+
+        /* Allocate the chunks and the workers. */
+        static struct chunk chunk[2];
+        struct worker * const workers = calloc(n_workers, sizeof(*workers));
+        char * const carry = malloc(CHUNK_SIZE);
+        if ((workers == NULL) || (carry == NULL))
+                exit_with_error("could not allocate memory", NULL);
+        for (i = 0; i < 2; i++) {
+                if ((chunk[i].data = malloc(CHUNK_SIZE + 1)) == NULL)
+                        exit_with_error("could not allocate memory", NULL);
+        }
+
+        /*
+         * Process the chunks. The output of the previous chunk is written and
+         * the next chunk is read while the current one is processed.
+         */
+        size_t carry_size = 0;
+        long line = 0;
+        int current = 0, pending = 0;
+        chunk_read(chunk, carry, &carry_size, fin, input);
+        while (chunk[current].size > 0) {
+                struct chunk * const next = chunk + (1 - current);
+                chunk_start(chunk + current, n_workers, workers);
+                if (pending) chunk_write(next, fout, output);
+                chunk_read(next, carry, &carry_size, fin, input);
+                chunk_wait(chunk + current, &line, input);
+                pending = 1;
+                current = 1 - current;
+        }
+        if (pending) chunk_write(chunk + (1 - current), fout, output);
+        if (fclose(fout) != 0) exit_with_error("could not write `%s`", output);
+        if (fin != stdin) fclose(fin);
+        if (_n_invalid > 0) {
+                fprintf(stderr,
+                    "gull-eval: %ld record(s) out of the model domain, set to "
+                    "NaN (first at %s %ld of `%s`)\n",
+                    _n_invalid, settings.binary ? "record" : "line",
+                    _first_invalid, input);
+        }
+
+        /* Free the memory. */
+        for (i = 0; i < 2; i++) {
+                int j;
+                for (j = 0; j < MAX_THREADS; j++) free(chunk[i].part[j].output);
+                free(chunk[i].data);
+        }
+        for (i = 0; i < n_workers; i++) free(workers[i].workspace);
+        free(workers);
+        free(carry);
+        gull_snapshot_destroy(&settings.snapshot);
+        gull_model_destroy(&settings.model);
+
+        exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2017 Université Clermont Auvergne, CNRS/IN2P3, LPC
+ * Author: Valentin NIESS (niess@in2p3.fr)
+ *
+ * Geomagnetic UtiLities Library (GULL)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Compute regular latitude, longitude maps of the geomagnetic field, at one or
+ * more altitudes, and stream them to a raw binary file.
+ *
+ * The output file starts with a header, in native byte order, i.e.
+ *
+ *     char    magic[8]        "GULLMAP1"
+ *     int32   byte_order      0x01020304
+ *     int32   n_altitude
+ *     int32   n_latitude
+ *     int32   n_longitude
+ *     double  date            (decimal year)
+ *     double  latitude[2]     (deg)
+ *     double  longitude[2]    (deg)
+ *     double  altitude[n_altitude] (m)
+ *
+ * It is followed by the maps, one per altitude. Each map is stored row by row,
+ * i.e. by increasing latitude, each row holding the E, N, U components (T) of
+ * the field as doubles, by increasing longitude. Maps are computed and written
+ * by blocks of rows, thus their size is not limited by the available memory.
+ */
+
+#include "gull.h"
+/* C89 standard library */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* C99 standard library */
+#include <stdint.h>
+
+#define MAX_ALTITUDES 64
+
+/* Error handler: dump any error message and exit to the OS. */
+static void handle_error(
+    enum gull_return rc, gull_function_t * caller, const char * message)
+{
+        fprintf(stderr, "gull-map: %s\n", message);
+        exit(EXIT_FAILURE);
+}
+
+static void exit_with_usage(void)
+{
+        fprintf(stderr,
+            "usage: gull-map [OPTIONS] MODEL DATE OUTPUT\n"
+            "\n"
+            "Compute maps of the geomagnetic field of MODEL at DATE, given as\n"
+            "a decimal year, and write them to OUTPUT.\n"
+            "\n"
+            "Options:\n"
+            "  -a, --altitude=Z      map altitude, in m [0]. This option can\n"
+            "                        be repeated.\n"
+            "  -b, --block=N         number of rows per block [64]\n"
+            "  -r, --resolution=D    map resolution, in deg [1]\n"
+            "      --latitude=A,B    latitude range, in deg [-90,90]\n"
+            "      --longitude=A,B   longitude range, in deg [-180,180]\n");
+        exit(EXIT_FAILURE);
+}
+
+/* Get the value of an option, either as attached or as the next argument. */
+static const char * option_value(int argc, char * argv[], int * i,
+    const char * short_name, const char * long_name)
+{
+        const char * arg = argv[*i];
+        const size_t n = strlen(long_name);
+        if ((short_name != NULL) && (strcmp(arg, short_name) == 0)) {
+                if (*i + 1 >= argc) exit_with_usage();
+                return argv[++(*i)];
+        } else if (strncmp(arg, long_name, n) == 0) {
+                if (arg[n] == '=') return arg + n + 1;
+                if (arg[n] != '\0') return NULL;
+                if (*i + 1 >= argc) exit_with_usage();
+                return argv[++(*i)];
+        }
+        return NULL;
+}
+
+/* Parse a floating point value, or a range of values. */
+static void parse_values(const char * arg, int n, double * values)
+{
+        char * end;
+        int i;
+        for (i = 0; i < n; i++) {
+                values[i] = strtod(arg, &end);
+                if ((end == arg) || ((i < n - 1) && (*end != ',')))
+                        exit_with_usage();
+                arg = end + 1;
+        }
+        if (*end != '\0') exit_with_usage();
+}
+
+/* Get the number of nodes over a range, for some resolution. */
+static int range_nodes(const double range[2], double resolution)
+{
+        const double n = (range[1] - range[0]) / resolution + 1.5;
+        if (!((n >= 1.) && (n <= INT32_MAX))) exit_with_usage();
+        return (int)n;
+}
+
+int main(int argc, char * argv[])
+{
+        /* Parse the command line. */
+        double altitude[MAX_ALTITUDES];
+        double latitude[2] = { -90., 90. }, longitude[2] = { -180., 180. };
+        double resolution = 1.;
+        int n_altitude = 0, block = 64;
+        const char * positional[3];
+        int i, n_positional = 0;
+        for (i = 1; i < argc; i++) {
+                const char * value;
+                if ((value = option_value(
+                         argc, argv, &i, "-a", "--altitude")) != NULL) {
+                        if (n_altitude >= MAX_ALTITUDES) exit_with_usage();
+                        parse_values(value, 1, altitude + n_altitude++);
+                } else if ((value = option_value(
+                                argc, argv, &i, "-b", "--block")) != NULL) {
+                        double b;
+                        parse_values(value, 1, &b);
+                        if (!((b >= 1.) && (b <= 1E+06))) exit_with_usage();
+                        block = (int)b;
+                } else if ((value = option_value(argc, argv, &i, "-r",
+                                "--resolution")) != NULL) {
+                        parse_values(value, 1, &resolution);
+                        if (!(resolution > 0.)) exit_with_usage();
+                } else if ((value = option_value(argc, argv, &i, NULL,
+                                "--latitude")) != NULL) {
+                        parse_values(value, 2, latitude);
+                } else if ((value = option_value(argc, argv, &i, NULL,
+                                "--longitude")) != NULL) {
+                        parse_values(value, 2, longitude);
+                } else if ((argv[i][0] == '-') && (argv[i][1] != '\0')) {
+                        exit_with_usage();
+                } else {
+                        if (n_positional >= 3) exit_with_usage();
+                        positional[n_positional++] = argv[i];
+                }
+        }
+        if (n_positional != 3) exit_with_usage();
+        if (n_altitude == 0) altitude[n_altitude++] = 0.;
+        double date;
+        parse_values(positional[1], 1, &date);
+        const int n_latitude = range_nodes(latitude, resolution);
+        const int n_longitude = range_nodes(longitude, resolution);
+        if (block > n_latitude) block = n_latitude;
+
+        /* Get a snapshot of the geomagnetic field. */
+        gull_error_handler_set(&handle_error);
+        struct gull_model * model;
+        struct gull_snapshot * snapshot = NULL;
+        gull_model_create(&model, positional[0]);
+        gull_model_snapshot(model, date, &snapshot);
+        gull_model_destroy(&model);
+
+        /* Write the header. */
+        FILE * fid = fopen(positional[2], "wb");
+        if (fid == NULL) {
+                fprintf(stderr, "gull-map: could not open file `%s`\n",
+                    positional[2]);
+                exit(EXIT_FAILURE);
+        }
+        const int32_t header[4] = { 0x01020304, n_altitude, n_latitude,
+                n_longitude };
+        const double range[5] = { date, latitude[0], latitude[1],
+                longitude[0], longitude[1] };
+        if ((fwrite("GULLMAP1", 8, 1, fid) != 1) ||
+            (fwrite(header, sizeof(header), 1, fid) != 1) ||
+            (fwrite(range, sizeof(range), 1, fid) != 1) ||
+            (fwrite(altitude, sizeof(*altitude), n_altitude, fid) !=
+                (size_t)n_altitude))
+                goto exit_on_write_error;
+
+        /* Compute and write the maps, by blocks of rows. */
+        const size_t size = 3 * (size_t)block * n_longitude;
+        double * field = malloc(size * sizeof(*field));
+        if (field == NULL) {
+                fprintf(stderr, "gull-map: could not allocate memory\n");
+                exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < n_altitude; i++) {
+                int row;
+                for (row = 0; row < n_latitude; row += block) {
+                        const int n_rows = (row + block <= n_latitude) ?
+                            block :
+                            n_latitude - row;
+                        gull_snapshot_field_map(snapshot, altitude[i],
+                            latitude, n_latitude, longitude, n_longitude, row,
+                            n_rows, field);
+                        const size_t n = 3 * (size_t)n_rows * n_longitude;
+                        if (fwrite(field, sizeof(*field), n, fid) != n)
+                                goto exit_on_write_error;
+                }
+        }
+        free(field);
+        gull_snapshot_destroy(&snapshot);
+        if (fclose(fid) != 0) goto exit_on_write_error;
+
+        exit(EXIT_SUCCESS);
+
+exit_on_write_error:
+        fprintf(stderr, "gull-map: could not write file `%s`\n", positional[2]);
+        exit(EXIT_FAILURE);
+}